@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstdint>
+
+// Allocation tracking, enabled by COMPY_TRACK_ALLOCATIONS definition
+// (`compy --track-allocations`). Operator new replaced in runtime.cc
+// attributes every allocation to category of innermost Scope of current
+// thread, and reports totals and peak of live bytes at exit.
+namespace python::allocation
+{
+	enum class Category : std::uint8_t
+	{
+		Other,
+		List,
+		Str,
+		Keyword_Arguments,
+		BigInt,
+		Count
+	};
+
+	inline constexpr char const* category_names[] = { "other", "list", "str", "keyword_arguments", "bigint" };
+
+#ifdef COMPY_TRACK_ALLOCATIONS
+	inline constinit thread_local Category current = Category::Other;
+
+	/// Attributes allocations made during its lifetime to category
+	struct Scope
+	{
+		Category previous;
+
+		explicit Scope(Category category)
+			: previous(current)
+		{
+			current = category;
+		}
+
+		Scope(Scope const&) = delete;
+		Scope& operator=(Scope const&) = delete;
+
+		~Scope()
+		{
+			current = previous;
+		}
+	};
+#else
+	struct Scope
+	{
+		explicit Scope(Category) {}
+	};
+#endif
+}
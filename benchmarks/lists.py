@@ -0,0 +1,18 @@
+def build(n: int) -> int:
+    total = 0
+    for round in range(n):
+        nums = []
+        for i in range(1000):
+            nums.append(i)
+        total += sum(nums) + len(nums)
+    return total
+
+def pad(n: int) -> int:
+    total = 0
+    for round in range(n):
+        zeros = [0] * 1000
+        total += len(zeros + zeros)
+    return total
+
+print(build(1000))
+print(pad(10000))
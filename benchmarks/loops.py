@@ -0,0 +1,16 @@
+def triangle(n: int) -> int:
+    count = 0
+    for i in range(n):
+        for j in range(i):
+            count += 1
+    return count
+
+def countdown(n: int) -> int:
+    steps = 0
+    while n > 0:
+        n -= 1
+        steps += 1
+    return steps
+
+print(triangle(3000))
+print(countdown(5000000))
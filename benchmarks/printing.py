@@ -0,0 +1,5 @@
+def lines(n: int):
+    for i in range(n):
+        print(i, "line", i * 2, [i, i + 1], sep=", ")
+
+lines(200000)
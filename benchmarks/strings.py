@@ -0,0 +1,8 @@
+def concat(n: int) -> int:
+    s = ""
+    for i in range(n):
+        s += "ab"
+        s += str(i)
+    return len(s)
+
+print(concat(500000))
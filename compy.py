@@ -1,24 +1,256 @@
+from __future__ import annotations
+from collections.abc import Callable
 from dataclasses import dataclass, field
 import argparse
 import ast
+import concurrent.futures
+import contextlib
+import copy
+import hashlib
+import io
+import json
+import re
 import shlex
+import shutil
+import statistics
 import subprocess
 import sys
+import tempfile
 import textwrap
+import threading
+import time
+import tokenize
 import os.path
 
 silent_mode = False
+
+# Progress messages and benchmark results, moved to standard error when
+# standard output holds JSON written by --bench-json -
+messages = sys.stdout
+
+# Allocate temporary lists from per block arena
+arena_mode = False
+
+# Reuse executables of unchanged programs from cache_directory()
+cache_mode = True
+
+# Compile each function separately, rebuilding only changed ones
+incremental_mode = False
+
+# Instrument functions and loops with timers from profile.hh
+profile_mode = False
 compy_location = os.path.dirname(__file__)
 
 def run_command(cmd, **kwargs):
     if not silent_mode:
-        print("[CMD] %s" % " ".join(map(shlex.quote, cmd)), flush=True)
+        print("[CMD] %s" % " ".join(map(shlex.quote, cmd)), file=messages, flush=True)
     return subprocess.run(cmd, **kwargs)
 
+# Limits number of compiler processes running at once, so that parallel
+# builds of many files and their translation units share -j workers
+compiler_slots = threading.BoundedSemaphore(os.cpu_count() or 1)
+
+def run_compiler(cmd, **kwargs):
+    with compiler_slots:
+        return run_command(cmd, **kwargs)
+
+class Compilation_Error(Exception):
+    pass
+
+# How generated C++ code is compiled into executable
+@dataclass
+class Build_Profile:
+    cxx : str = "g++"
+    opt_level : str = "2"
+
+    # Target architecture passed as -march, like "native"
+    march : str | None = None
+    lto : bool = False
+
+    # Input fed into instrumented build for profile guided optimization,
+    # "" for no input. PGO is disabled when None.
+    pgo_training_input : str | None = None
+
+    # Count allocations by runtime type, see allocation.hh
+    track_allocations : bool = False
+
+    # Count allocations for report of timers from profile.hh
+    profile : bool = False
+
+    def is_clang(self) -> bool:
+        return "clang" in os.path.basename(self.cxx)
+
+    def flags(self) -> list[str]:
+        flags = ["-std=c++20", f"-O{self.opt_level}", "-pthread", "-Wall", "-Wextra", "-Wno-unused-variable"]
+        if self.march:
+            flags.append(f"-march={self.march}")
+        if self.lto:
+            flags.append("-flto" if self.is_clang() else "-flto=auto")
+        if self.track_allocations:
+            flags.append("-DCOMPY_TRACK_ALLOCATIONS")
+        if self.profile:
+            flags.append("-DCOMPY_PROFILE")
+        return flags
+
+    def pgo_generate_flags(self, profile_dir: str) -> list[str]:
+        if self.is_clang():
+            return [f"-fprofile-instr-generate={profile_dir}/%p.profraw"]
+        return [f"-fprofile-generate={profile_dir}"]
+
+    def pgo_use_flags(self, profile_dir: str) -> list[str]:
+        if self.is_clang():
+            return [f"-fprofile-instr-use={profile_dir}/merged.profdata"]
+        return [f"-fprofile-use={profile_dir}", "-fprofile-correction", "-Wno-missing-profile"]
+
+    def command(self, source: str, output: str, extra_flags: list[str] = []) -> list[str]:
+        runtime = prebuilt_runtime(self)
+        return [self.cxx, *self.flags(), *extra_flags, *runtime.include_flags, source, runtime.library, "-o", output, f"-I{compy_location}"]
+
+    def compile_command(self, source: str, output: str) -> list[str]:
+        runtime = prebuilt_runtime(self)
+        return [self.cxx, *self.flags(), *runtime.include_flags, "-c", source, "-o", output, f"-I{compy_location}"]
+
+    def link_command(self, objects: list[str], output: str) -> list[str]:
+        return [self.cxx, *self.flags(), *objects, prebuilt_runtime(self).library, "-o", output]
+
+# Files that make up runtime of generated programs
+runtime_sources = ["std.hh", "allocation.hh", "hash_table.hh", "integer.hh", "io.hh", "output.hh", "parallel.hh", "profile.hh", "simd.hh", "str.hh", "runtime.cc"]
+
+def cache_directory() -> str:
+    if "COMPY_CACHE_DIR" in os.environ:
+        return os.environ["COMPY_CACHE_DIR"]
+    return os.path.join(os.environ.get("XDG_CACHE_HOME", os.path.expanduser("~/.cache")), "compy")
+
+def runtime_hash(profile: Build_Profile) -> str:
+    "Identifies runtime build by its sources and compiler flags"
+    h = hashlib.sha256()
+    h.update(repr((profile.cxx, profile.flags())).encode())
+    for name in runtime_sources:
+        with open(os.path.join(compy_location, name), "rb") as f:
+            h.update(f.read())
+    return h.hexdigest()[:16]
+
+@dataclass
+class Prebuilt_Runtime:
+    # Flags making compiler use precompiled std.hh
+    include_flags : list[str]
+    library : str
+
+prebuilt_runtimes : dict[str, Prebuilt_Runtime] = {}
+prebuilt_runtimes_lock = threading.Lock()
+
+def prebuilt_runtime(profile: Build_Profile) -> Prebuilt_Runtime:
+    """
+    Precompiled std.hh and libcompy_rt.a built with flags of profile, cached
+    across compy invocations in cache_directory()
+    """
+    key = runtime_hash(profile)
+    with prebuilt_runtimes_lock:
+        if key not in prebuilt_runtimes:
+            prebuilt_runtimes[key] = build_cached_runtime(profile, key)
+        return prebuilt_runtimes[key]
+
+def build_cached_runtime(profile: Build_Profile, key: str) -> Prebuilt_Runtime:
+
+    directory = os.path.join(cache_directory(), "runtime-" + key)
+    pch = os.path.join(directory, "std.hh.pch" if profile.is_clang() else "std.hh.gch")
+    library = os.path.join(directory, "libcompy_rt.a")
+
+    if not os.path.exists(library):
+        # Build in private directory and rename it, so concurrent compy
+        # processes never observe partially built runtime
+        os.makedirs(cache_directory(), exist_ok=True)
+        staging = tempfile.mkdtemp(prefix="runtime-", dir=cache_directory())
+        try:
+            build_runtime(profile, staging)
+            try:
+                os.rename(staging, directory)
+            except OSError:
+                pass # Built by another process in the meantime
+        finally:
+            shutil.rmtree(staging, ignore_errors=True)
+
+    # GCC searches for std.hh.gch next to std.hh in include path, before
+    # actual header, clang needs to be told explicitly
+    include_flags = ["-include-pch", pch] if profile.is_clang() else [f"-I{directory}"]
+    return Prebuilt_Runtime(include_flags, library)
+
+def build_runtime(profile: Build_Profile, directory: str):
+    pch = os.path.join(directory, "std.hh.pch" if profile.is_clang() else "std.hh.gch")
+    obj = os.path.join(directory, "runtime.o")
+    if profile.lto:
+        ar = "llvm-ar" if profile.is_clang() else "gcc-ar"
+    else:
+        ar = "ar"
+
+    for cmd in [
+        [profile.cxx, *profile.flags(), "-x", "c++-header", os.path.join(compy_location, "std.hh"), "-o", pch],
+        [profile.cxx, *profile.flags(), "-c", os.path.join(compy_location, "runtime.cc"), "-o", obj],
+        [ar, "rcs", os.path.join(directory, "libcompy_rt.a"), obj],
+    ]:
+        if run_compiler(cmd).returncode != 0:
+            raise Compilation_Error("Compilation of runtime failed")
+    os.unlink(obj)
+
+# Intermediate representation of generated code. Visitor lowers Python
+# statements into C++ statements nested in blocks, which passes transform
+# before they're rendered as text.
+@dataclass
+class Statement:
+    "C++ statement without terminating semicolon"
+    code : str
+
+    # Python statement it was lowered from, None for helper statements
+    source : ast.stmt | None = None
+
+@dataclass
+class Block:
+    "Compound statement like loop, `head { body }`, ended by close"
+    head : str
+    body : list[Statement | Block] = field(default_factory=list)
+    close : str = "}"
+
+def render(nodes: list[Statement | Block], depth: int = 1) -> str:
+    indent, code = "  " * depth, ""
+    for node in nodes:
+        if isinstance(node, Block):
+            code += f"{indent}{node.head} {{\n" if node.head else f"{indent}{{\n"
+            code += render(node.body, depth + 1) + f"{indent}{node.close}\n"
+        else:
+            code += f"{indent}{node.code};\n"
+    return code
+
+def walk_statements(nodes: list[Statement | Block]):
+    "Yields statements of nodes and of blocks nested in them"
+    for node in nodes:
+        if isinstance(node, Block):
+            yield from walk_statements(node.body)
+        else:
+            yield node
+
+def walk_blocks(nodes: list[Statement | Block]):
+    "Yields lists of nodes in body of function, starting with the body itself"
+    yield nodes
+    for node in nodes:
+        if isinstance(node, Block):
+            yield from walk_blocks(node.body)
+
+# Functions are identified by their name when there is a single version of
+# them in the generated code, or by their signature when specialized
 @dataclass
 class Code_Generator:
     # Bodies of functions by their name
-    bodies : dict[str, str] = field(default_factory=dict)
+    bodies : dict[str, list[Statement | Block]] = field(default_factory=dict)
+
+    # Innermost open block of function by its name, with blocks enclosing it
+    open_blocks : dict[str, list[list[Statement | Block]]] = field(default_factory=dict)
+
+    # Inferred types and Python body of function by their name
+    types : dict[str, Function_Types] = field(default_factory=dict)
+    sources : dict[str, list[ast.stmt]] = field(default_factory=dict)
+
+    # C++ names of functions that are identified by signature
+    cpp_names : dict[str, str] = field(default_factory=dict)
 
     # Function definition stack
     names : list[str] = field(default_factory=list)
@@ -29,11 +261,52 @@ class Code_Generator:
     # Return type of function by their name
     return_types : dict[str, str] = field(default_factory=dict)
 
-    def add_statement(self, statement: str):
+    # Local variable declarations (name -> C++ type) of function by their name
+    locals : dict[str, dict[str, str]] = field(default_factory=dict)
+
+    # Names of string constants by their value
+    strings : dict[str, str] = field(default_factory=dict)
+
+    # Functions referencing string constant by it's name
+    string_users : dict[str, set[str]] = field(default_factory=dict)
+
+    # Python source line of function by their name
+    lines : dict[str, int] = field(default_factory=dict)
+
+    def string_constant(self, s: str) -> str:
+        "Name of static string with given value, defined once per program"
+        if s not in self.strings:
+            self.strings[s] = "compy_str_%d" % (len(self.strings),)
+        if self.names:
+            self.string_users.setdefault(self.strings[s], set()).add(self.names[-1])
+        return self.strings[s]
+
+    def current_block(self) -> list[Statement | Block]:
         name = self.names[-1]
         if name not in self.bodies:
-            self.bodies[name] = ""
-        self.bodies[name] += f"  {statement};\n"
+            self.bodies[name] = []
+            self.open_blocks[name] = [self.bodies[name]]
+        return self.open_blocks[name][-1]
+
+    def add_statement(self, statement: str, source: ast.stmt | None = None):
+        self.current_block().append(Statement(statement, source))
+
+    def begin_block(self, head: str, close: str = "}"):
+        "Following statements are added into new block, until end_block()"
+        block = Block(head, close=close)
+        self.current_block().append(block)
+        self.open_blocks[self.names[-1]].append(block.body)
+
+    def end_block(self):
+        assert len(self.open_blocks[self.names[-1]]) > 1, "No block to end"
+        self.open_blocks[self.names[-1]].pop()
+
+    def mark(self) -> int:
+        "Position in the current block, where statements can be inserted later"
+        return len(self.current_block())
+
+    def insert_statement(self, mark: int, statement: str):
+        self.current_block().insert(mark, Statement(statement))
 
     def enter_function(self, name : str):
         self.names.append(name)
@@ -51,44 +324,898 @@ class Code_Generator:
 
         return Function_Context()
 
+    def functions(self) -> list[tuple[str, str, str, bool]]:
+        """
+        Name, declaration and body of each function, with compy_main last.
+        Last element tells whether function has fully known signature and
+        thus can be declared upfront, which allows calling it before it's
+        definition.
+        """
+        functions = []
+        main = None
+
+        for name, body in self.bodies.items():
+            if name in self.return_types:
+                return_type = self.return_types[name]
+            else:
+                return_type = "void" if name == "compy_main" else "auto"
+
+            args = ', '.join(self.args.get(name, []))
+
+            declaration = "%s %s(%s)" % (return_type, self.cpp_names.get(name, name), args)
+            body = ''.join(
+                f"  {type} {var}{{}};\n"
+                for var, type in self.locals.get(name, {}).items()) + render(body)
+            if profile_mode:
+                body = ''.join(f"  {stmt};\n" for stmt in profile_timer(python_name(name), self.lines.get(name, 1))) + body
+            known = return_type != "auto" and not any(arg.startswith("auto ") for arg in self.args.get(name, []))
+
+            if name == "compy_main":
+                main = (name, declaration, body, True)
+            else:
+                functions.append((name, declaration, body, known))
+
+        return functions + [main]
+
+    def string_definition(self, value: str, qualifier: str) -> str:
+        return "%s python::Str const %s(%s, %d);\n" % (qualifier, self.strings[value], cpp_string_literal(value), len(value.encode()))
+
     def save(self, filename : str):
         with open(filename, 'w') as f:
             f.write("#include <std.hh>\n")
-            functions = []
-            main = None
-
-            for name, body in self.bodies.items():
-                if name in self.return_types:
-                    return_type = self.return_types[name]
-                else:
-                    return_type = "void" if name == "compy_main" else "auto"
-
-                if name in self.args:
-                    args = ', '.join("auto " + arg for arg in self.args[name])
-                else:
-                    args = ""
-
-                declaration = "%s %s(%s)" % (return_type, name, args)
-                if name == "compy_main":
-                    main = (declaration, body)
-                else:
-                    functions.append((declaration, body))
-
-            for declaration, body in functions:
+            if self.strings:
+                f.write("\n")
+            for value in self.strings:
+                f.write(self.string_definition(value, "static"))
+
+            functions = self.functions()
+            for name, declaration, body, known in functions[:-1]:
+                if known:
+                    f.write("\n%s;" % (declaration,))
+
+            f.write("\n")
+            for name, declaration, body, known in functions[:-1]:
                 f.write("\n%s\n{\n%s}\n" % (declaration, body))
 
-            f.write("\n%s\n{\n%s}\n" % main)
+            f.write("\n%s\n{\n%s}\n" % functions[-1][1:3])
+
+    def save_incremental(self, directory: str) -> list[str]:
+        """
+        Writes program as translation unit per function with fully known
+        signature, sharing program.hh with their declarations. Generic
+        functions must be visible to their callers, so they are defined in
+        the header. Returns paths of translation units.
+        """
+        functions = self.functions()
+        in_header = { name for name, _, _, known in functions if not known }
+
+        # std.hh is included by translation units, since precompiled header
+        # can only be used by first include
+        header = "#pragma once\n\n"
+        for value, name in self.strings.items():
+            if self.string_users.get(name, set()) & in_header:
+                header += self.string_definition(value, "inline")
+        for name, declaration, body, known in functions[:-1]:
+            if known:
+                header += "%s;\n" % (declaration,)
+        for name, declaration, body, known in functions:
+            if not known:
+                header += "\ninline %s\n{\n%s}\n" % (declaration, body)
+        write_if_changed(os.path.join(directory, "program.hh"), header)
+
+        units = []
+        for name, declaration, body, known in functions:
+            if not known:
+                continue
+            unit = "#include <std.hh>\n#include \"program.hh\"\n\n"
+            for value, string in self.strings.items():
+                users = self.string_users.get(string, set())
+                if name in users and not users & in_header:
+                    unit += self.string_definition(value, "static")
+            unit += "\n%s\n{\n%s}\n" % (declaration, body)
+
+            # Specializations share C++ name, so file is named after hash of signature
+            cpp_name = self.cpp_names.get(name, name)
+            filename = os.path.join(directory, "%s_%s.cc" % (cpp_name, hashlib.sha256(name.encode()).hexdigest()[:8]))
+            write_if_changed(filename, unit)
+            units.append(filename)
+        return units
+
+def profile_timer(name: str, line: int) -> list[str]:
+    "Statements measuring rest of the current scope as site of profile report"
+    return [
+        f"static python::profile::Site compy_site({cpp_string_literal(name)}, {line})",
+        "python::profile::Timer compy_timer(compy_site)",
+    ]
+
+def python_name(function: str) -> str:
+    return "<module>" if function == "compy_main" else function
+
+def write_if_changed(filename: str, content: str):
+    "Keeps modification time of unchanged files, which build tools rely on"
+    if os.path.exists(filename):
+        with open(filename) as f:
+            if f.read() == content:
+                return
+    with open(filename, "w") as f:
+        f.write(content)
+
+
+def cpp_string_literal(s: str) -> str:
+    escapes = { '"': '\\"', '\\': '\\\\', '\n': '\\n', '\t': '\\t', '\r': '\\r' }
+    result = ""
+    for byte in s.encode():
+        c = chr(byte)
+        if c in escapes:           result += escapes[c]
+        elif 0x20 <= byte < 0x7f:  result += c
+        else:                      result += "\\%03o" % (byte,)
+    return '"%s"' % (result,)
+
+# Precedence of C++ operators in generated expressions, higher binds tighter
+postfix_precedence, unary_precedence, multiplicative_precedence, additive_precedence, comparison_precedence = 5, 4, 3, 2, 1
+
+class Expression(str):
+    "Generated C++ expression with precedence of its outermost operator"
+    precedence : int
+
+    def __new__(cls, code: str, precedence: int):
+        expression = super().__new__(cls, code)
+        expression.precedence = precedence
+        return expression
+
+def operand(code: str, precedence: int, left: bool = False) -> str:
+    """
+    Code of operand of operator with given precedence, in parentheses unless
+    it binds tighter, or equally tight on the left of left associative one.
+    Plain strings, like conditional expressions, bind the loosest.
+    """
+    binds = getattr(code, "precedence", 0)
+    return code if binds > precedence or (left and binds == precedence) else "(%s)" % (code,)
+
+def cpp_int(i: int) -> str:
+    if -2**63 < i < 2**63:
+        return Expression("%d" % (i,), postfix_precedence if i >= 0 else unary_precedence)
+    return Expression('python::Integer(python::BigInt("%d"))' % (i,), postfix_precedence)
+
+def constant_int(expr: ast.expr) -> int | None:
+    "Value of integer literal, possibly negated, None for other expressions"
+    negate = isinstance(expr, ast.UnaryOp) and isinstance(expr.op, ast.USub)
+    if negate:
+        expr = expr.operand
+    if isinstance(expr, ast.Constant) and type(expr.value) is int and expr.value < 2**63:
+        return -expr.value if negate else expr.value
+    return None
+
+# Types are represented as strings: "int", "bool", "str", "None", "range",
+# "list" (list of anything) or "list[T]" (list with elements of type T),
+# "dict" and "set" (with keys and values of any type), "generator[T]" for
+# generator expressions yielding values of type T,
+# "any" for values which type is only known at runtime and "?" for values
+# which type was not inferred (yet).
+Unknown = "?"
+Any = "any"
+
+annotation_types = { "int": "int", "bool": "bool", "str": "str", "list": "list", "dict": "dict", "set": "set", "any": Any }
+
+def list_of(element: str) -> str:
+    return "list" if element == Any else f"list[{element}]"
+
+def is_list(t: str) -> bool:
+    return t == "list" or t.startswith("list[")
+
+def element_type(t: str) -> str:
+    return t[len("list["):-1] if t.startswith("list[") else Any
+
+def generator_of(element: str) -> str:
+    return f"generator[{element}]"
+
+def is_generator(t: str) -> bool:
+    return t.startswith("generator[")
+
+def iterated_type(t: str) -> str:
+    "Type of elements that iteration over value of type t yields"
+    if t == "range":          return "int"
+    if t in ("file", "str"):  return "str"
+    if is_list(t):            return element_type(t)
+    if is_generator(t):       return t[len("generator["):-1]
+    return Unknown if t == Unknown else Any
+
+def unify(a: str, b: str) -> str:
+    if a == Unknown: return b
+    if b == Unknown: return a
+    if a == b:       return a
+    if is_list(a) and is_list(b):
+        return list_of(unify(element_type(a), element_type(b)))
+    return Any
+
+# Element types of lists which are stored as python::Typed_List
+typed_list_elements = { "int": "python::Int", "bool": "python::Bool", "str": "python::Str" }
+
+def cpp_type(t: str) -> str:
+    if t == Unknown:  return "auto"
+    if t == "int":    return "python::Integer"
+    if t == "bool":   return "bool"
+    if t == "str":    return "python::Str"
+    if element_type(t) in typed_list_elements:
+        return "python::Typed_List<%s>" % (typed_list_elements[element_type(t)],)
+    if is_list(t):    return "list"
+    if t == "range":  return "Range"
+    if t == "file":   return "python::File"
+    if t == "dict":   return "python::Dict"
+    if t == "set":    return "python::Set"
+    return "any"
+
+def is_movable(t: str) -> bool:
+    "Values of type own memory, so moving them is cheaper than copying"
+    return is_list(t) or t in ("str", "dict", "set", Any, Unknown)
+
+# Builtins that only read their arguments
+read_only_builtins = ("print", "len", "sum", "min", "max", "any", "all")
+
+# Builtins consuming single iterable, which may be generator expression
+iterating_builtins = ("sum", "min", "max", "any", "all")
+
+# Methods of dict that only read it
+read_only_methods = ("get", "keys", "values", "items")
+
+def only_viewed(name: str, statements: list[ast.stmt], is_str) -> bool:
+    """
+    Variable is only read by print(), len() and comparisons with strings,
+    so it can be a view of string that it's bound to instead of its copy
+    """
+    for node in (node for stmt in statements for node in ast.walk(stmt)):
+        for child in ast.iter_child_nodes(node):
+            if not (isinstance(child, ast.Name) and child.id == name):
+                continue
+            if isinstance(node, ast.Call) and isinstance(node.func, ast.Name) and node.func.id in ("print", "len") and child in node.args:
+                continue
+            if isinstance(node, ast.Compare) and not any(isinstance(op, (ast.In, ast.NotIn)) for op in node.ops) \
+                    and all(is_str(operand) for operand in (node.left, *node.comparators) if operand is not child):
+                continue
+            return False
+    return True
+
+def mutates(name: str, statements: list[ast.stmt]) -> bool:
+    "Statements may rebind variable or modify value that it refers to"
+    for node in (node for stmt in statements for node in ast.walk(stmt)):
+        if isinstance(node, ast.Name) and node.id == name and not isinstance(node.ctx, ast.Load):
+            return True
+        # Methods, like append(), and stores into elements modify value in place
+        if isinstance(node, (ast.Attribute, ast.Subscript)) and isinstance(node.value, ast.Name) and node.value.id == name:
+            if (isinstance(node, ast.Attribute) and node.attr not in read_only_methods) or isinstance(node.ctx, (ast.Store, ast.Del)):
+                return True
+    return False
+
+parallel_marker = re.compile(r"#\s*compy:\s*parallel\b")
+
+def mark_parallel_loops(tree: ast.Module, source: str):
+    "Flags for loops marked by `# compy: parallel` comment at the end of their line or on the line before"
+    lines = set()
+    for token in tokenize.generate_tokens(io.StringIO(source).readline):
+        if token.type == tokenize.COMMENT and parallel_marker.match(token.string):
+            standalone = token.line.lstrip().startswith("#")
+            lines.add(token.start[0] + standalone)
+    for node in ast.walk(tree):
+        if isinstance(node, ast.For):
+            node.parallel = node.lineno in lines
+
+# Expressions which parts may run repeatedly, like elements of comprehensions and bodies of lambdas
+deferred_expressions = (ast.ListComp, ast.SetComp, ast.DictComp, ast.GeneratorExp, ast.Lambda)
+
+def last_uses(body: list[ast.stmt], variables: set[str]) -> set[int]:
+    """
+    Ids of Name nodes that read variable for the last time, so its value
+    can be moved instead of copied. Inside loops only reads by assignment
+    rebinding the same variable, like `x = x + [i]`, qualify.
+    """
+    result = set()
+
+    def names(nodes):
+        return { n.id for node in nodes for n in ast.walk(node) if isinstance(n, ast.Name) }
+
+    def consumed(stmt: ast.stmt):
+        "Expressions which value is taken as a whole"
+        for node in ast.walk(stmt):
+            if isinstance(node, ast.Call) and not (isinstance(node.func, ast.Name) and node.func.id in read_only_builtins):
+                yield from node.args
+                yield from (keyword.value for keyword in node.keywords)
+            elif isinstance(node, ast.BinOp):
+                yield from (node.left, node.right)
+            elif isinstance(node, (ast.List, ast.Set)):
+                yield from node.elts
+            elif isinstance(node, ast.Dict):
+                yield from (key for key in node.keys if key is not None)
+                yield from node.values
+            elif isinstance(node, (ast.Assign, ast.AnnAssign)):
+                yield node.value
+
+    def visit(statements: list[ast.stmt], after: set[str], in_loop: bool):
+        for i, stmt in enumerate(statements):
+            later = after | names(statements[i+1:])
+            if isinstance(stmt, ast.If):
+                visit(stmt.body, later, in_loop)
+                visit(stmt.orelse, later, in_loop)
+            elif isinstance(stmt, (ast.For, ast.While)):
+                visit(stmt.body, later | names([stmt]), True)
+                visit(stmt.orelse, later, in_loop)
+            elif not isinstance(stmt, ast.FunctionDef):
+                repeated = { id(n) for c in ast.walk(stmt) if isinstance(c, deferred_expressions) for n in ast.walk(c) }
+                for node in consumed(stmt):
+                    if not (isinstance(node, ast.Name) and node.id in variables) or id(node) in repeated:
+                        continue
+                    uses = sum(isinstance(n, ast.Name) and n.id == node.id for n in ast.walk(stmt))
+                    target = stmt.targets[0] if isinstance(stmt, ast.Assign) and len(stmt.targets) == 1 else getattr(stmt, "target", None)
+                    rebinds = isinstance(stmt, (ast.Assign, ast.AnnAssign)) and isinstance(target, ast.Name) \
+                        and target.id == node.id and stmt.value is not node
+                    if (rebinds and uses == 2) or (not in_loop and uses == 1 and node.id not in later):
+                        result.add(id(node))
+
+    visit(body, set(), False)
+    return result
+
+def target_names(target: ast.expr) -> list[str]:
+    "Names bound by loop target, like `x` or `k, v`, empty for other targets"
+    elements = target.elts if isinstance(target, ast.Tuple) else [target]
+    return [e.id for e in elements] if all(isinstance(e, ast.Name) for e in elements) else []
+
+def is_items_call(expr: ast.expr) -> bool:
+    return isinstance(expr, ast.Call) and isinstance(expr.func, ast.Attribute) and expr.func.attr == "items" \
+        and not expr.args and not expr.keywords
+
+def is_stdin(expr: ast.expr) -> bool:
+    return isinstance(expr, ast.Attribute) and isinstance(expr.value, ast.Name) and expr.value.id == "sys" and expr.attr == "stdin"
+
+def annotation_type(annotation: ast.expr) -> str:
+    assert isinstance(annotation, ast.Name), "Only type names are supported now"
+    assert annotation.id in annotation_types, "Unsupported type annotation: " + annotation.id
+    return annotation_types[annotation.id]
 
+@dataclass
+class Function_Types:
+    # Arguments in order of declaration with their types
+    args : dict[str, str] = field(default_factory=dict)
+
+    # Local variables (excluding arguments) with their types
+    locals : dict[str, str] = field(default_factory=dict)
+
+    # Variables that are only bound by for loops and are declared by them
+    loop_variables : set[str] = field(default_factory=set)
+
+    # Variables (and arguments) with type given by annotation
+    annotated : set[str] = field(default_factory=set)
+
+    returns : str = Unknown
+    returns_annotated : bool = False
+
+    def lookup(self, name: str) -> str:
+        return self.args.get(name, self.locals.get(name, Unknown))
+
+    def declarations(self) -> dict[str, str]:
+        return {
+            name: cpp_type(Any if type == Unknown else type)
+            for name, type in self.locals.items()
+            if name not in self.loop_variables
+        }
+
+# Maximum number of specializations of single function. Further call site
+# signatures are served by specialization taking all arguments as `any`.
+max_specializations = 8
+
+def resolve_arguments(fun: ast.FunctionDef, call: ast.Call) -> list[ast.expr]:
+    "Arguments of call to user defined function in order of parameters, with keywords resolved"
+    params = [arg.arg for arg in fun.args.args]
+    assert len(call.args) <= len(params), f"{fun.name}() takes {len(params)} arguments but {len(call.args)} were given"
+    args = dict(zip(params, call.args))
+    for keyword in call.keywords:
+        assert keyword.arg is not None, "Unpacking of keyword arguments is not supported yet"
+        assert keyword.arg in params, f"{fun.name}() got an unexpected keyword argument '{keyword.arg}'"
+        assert keyword.arg not in args, f"{fun.name}() got multiple values for argument '{keyword.arg}'"
+        args[keyword.arg] = keyword.value
+    missing = [param for param in params if param not in args]
+    assert not missing, f"{fun.name}() missing required arguments: {', '.join(missing)}"
+    return [args[param] for param in params]
+
+# Keyword arguments of print() in order of declaration in python::Printer, with their types
+print_keywords = { "sep": "str", "end": "str", "flush": "bool" }
+
+class Type_Inference:
+    """
+    Infers types of function arguments, local variables and return values,
+    using annotations, literals and types of values at call sites.
+    Each function is specialized for every signature that it's called with.
+    Inference is repeated until no type changes, since types of arguments
+    depend on callers and types of calls on callees.
+    """
+    def __init__(self):
+        # Types shared by all specializations of function by their name
+        self.templates : dict[str, Function_Types] = {}
+
+        # Specializations of function by their name and signature
+        self.specializations : dict[str, dict[tuple[str, ...], Function_Types]] = {}
+
+        # Functions called with arguments which types are not known
+        self.unresolved : set[str] = set()
+
+        # Types of variables bound by enclosing comprehensions, innermost last
+        self.scopes : list[dict[str, str]] = []
+
+        self.changed = False
+
+    def infer(self, module: ast.Module) -> dict[str, list[Function_Types]]:
+        main_body = [ stmt for stmt in module.body if not isinstance(stmt, ast.FunctionDef) ]
+        definitions = self.definitions = { stmt.name: stmt for stmt in module.body if isinstance(stmt, ast.FunctionDef) }
+        bodies = { **{ name: fun.body for name, fun in definitions.items() }, "compy_main": main_body }
+
+        for name, body in bodies.items():
+            types = self.templates[name] = Function_Types()
+            if name == "compy_main":
+                types.returns, types.returns_annotated = "None", True
+            else:
+                fun = definitions[name]
+                for arg in fun.args.args:
+                    types.args[arg.arg] = Unknown
+                    if arg.annotation:
+                        types.args[arg.arg] = annotation_type(arg.annotation)
+                        types.annotated.add(arg.arg)
+                if fun.returns:
+                    types.returns = annotation_type(fun.returns)
+                    types.returns_annotated = True
+
+            # Variable is declared by the loop when it's only used inside loops binding it
+            names, in_loops, returns_value = set(), set(), False
+            for node in (n for stmt in body for n in ast.walk(stmt)):
+                if isinstance(node, ast.Name):
+                    names.add(node)
+                elif isinstance(node, ast.For) and target_names(node.target):
+                    in_loops.update(
+                        n for part in [node.target, *node.body] for n in ast.walk(part)
+                        if isinstance(n, ast.Name) and n.id in target_names(node.target))
+                elif isinstance(node, ast.Return) and node.value is not None:
+                    returns_value = True
+                elif isinstance(node, ast.AnnAssign):
+                    annotation = annotation_type(node.annotation)
+                    # Annotation `list` doesn't restrict type of elements
+                    if annotation == "list":
+                        types.locals[node.target.id] = list_of(Unknown)
+                    else:
+                        types.locals[node.target.id] = annotation
+                        types.annotated.add(node.target.id)
+            outside = { n.id for n in names - in_loops } | set(types.args)
+            types.loop_variables = { n.id for n in in_loops } - outside
+            if not returns_value and not types.returns_annotated:
+                types.returns = "None"
+
+            self.specializations[name] = {}
+
+        self.specializations["compy_main"][()] = copy.deepcopy(self.templates["compy_main"])
+
+        while True:
+            for _ in range(100):
+                self.changed = False
+                self.unresolved = set()
+                for name, specializations in self.specializations.items():
+                    for types in list(specializations.values()):
+                        self.current = types
+                        self.block(bodies[name])
+                if not self.changed:
+                    break
+
+            # Functions that are never called or called with arguments of unknown
+            # type are kept generic, and C++ deduces types of their arguments
+            generic = [
+                name for name, specializations in self.specializations.items()
+                if (name in self.unresolved or not specializations)
+                    and tuple(self.templates[name].args.values()) not in specializations
+            ]
+            if not generic:
+                break
+            for name in generic:
+                template = self.templates[name]
+                self.specializations[name][tuple(template.args.values())] = copy.deepcopy(template)
+
+        self.result = { name: list(specializations.values()) for name, specializations in self.specializations.items() }
+        return self.result
+
+    def specialize(self, name: str, arg_types: list[str]) -> Function_Types | None:
+        "Returns specialization of function `name` for call with arguments of types `arg_types`"
+        template, specializations = self.templates[name], self.specializations[name]
+        signature = tuple(
+            t if arg in template.annotated else arg_type
+            for (arg, t), arg_type in zip(template.args.items(), arg_types))
+
+        if Unknown in signature:
+            self.unresolved.add(name)
+            return None
+
+        if signature not in specializations and len(specializations) >= max_specializations:
+            signature = tuple(t if arg in template.annotated else Any for arg, t in template.args.items())
+
+        if signature not in specializations:
+            types = specializations[signature] = copy.deepcopy(template)
+            types.args = dict(zip(template.args, signature))
+            self.changed = True
+
+        return specializations[signature]
+
+    def refine(self, name: str, t: str):
+        "Extend type of variable `name` in current function with type `t`"
+        fun = self.current
+        if name in fun.annotated:
+            return
+        table = fun.args if name in fun.args else fun.locals
+        new = unify(table.get(name, Unknown), t)
+        if table.get(name) != new:
+            table[name] = new
+            self.changed = True
+
+    def assign(self, target: ast.expr, t: str):
+        if isinstance(target, ast.Name):
+            self.refine(target.id, t)
+        elif isinstance(target, ast.Subscript) and isinstance(target.value, ast.Name):
+            container = self.current.lookup(target.value.id)
+            if is_list(container):
+                self.refine(target.value.id, list_of(t))
+            self.expr(target.slice)
+
+    def block(self, statements: list[ast.stmt]):
+        for stmt in statements:
+            self.stmt(stmt)
+
+    def stmt(self, stmt: ast.stmt):
+        fun = self.current
+        if isinstance(stmt, ast.FunctionDef):
+            return
+        elif isinstance(stmt, ast.Assign):
+            t = self.expr(stmt.value)
+            for target in stmt.targets:
+                self.assign(target, t)
+        elif isinstance(stmt, ast.AnnAssign):
+            if stmt.value:
+                self.assign(stmt.target, self.expr(stmt.value))
+        elif isinstance(stmt, ast.AugAssign):
+            result = self.binop(stmt.op, self.expr(stmt.target), self.expr(stmt.value))
+            self.assign(stmt.target, result)
+        elif isinstance(stmt, ast.For):
+            element = iterated_type(self.expr(stmt.iter))
+            if isinstance(stmt.target, ast.Tuple):
+                for target in stmt.target.elts:
+                    self.assign(target, element)
+            else:
+                self.assign(stmt.target, element)
+            self.block(stmt.body)
+        elif isinstance(stmt, ast.While):
+            self.expr(stmt.test)
+            self.block(stmt.body)
+        elif isinstance(stmt, ast.Return):
+            t = self.expr(stmt.value) if stmt.value else "None"
+            if not fun.returns_annotated:
+                new = unify(fun.returns, t)
+                if new != fun.returns:
+                    fun.returns = new
+                    self.changed = True
+        elif isinstance(stmt, ast.Expr):
+            self.expr(stmt.value)
+
+    def binop(self, op: ast.operator, lhs: str, rhs: str) -> str:
+        if Unknown in (lhs, rhs): return Unknown
+        numeric = ("int", "bool")
+        if lhs in numeric and rhs in numeric and isinstance(op, (ast.Add, ast.Sub, ast.Mult, ast.Mod)):
+            return "int"
+        if isinstance(op, ast.Add) and lhs == rhs == "str":
+            return "str"
+        if isinstance(op, ast.Mult) and "str" in (lhs, rhs) and {lhs, rhs} & { "int", "bool" }:
+            return "str"
+        if isinstance(op, ast.Add) and is_list(lhs) and is_list(rhs):
+            return unify(lhs, rhs)
+        if isinstance(op, ast.Mult) and is_list(lhs) and rhs in numeric:
+            return lhs
+        return Any
+
+    def call(self, call: ast.Call) -> str:
+        arg_types = [self.expr(arg) for arg in call.args]
+        for keyword in call.keywords:
+            self.expr(keyword.value)
+
+        if isinstance(call.func, ast.Attribute):
+            self.expr(call.func.value)
+            obj = call.func.value
+            if call.func.attr == "append" and isinstance(obj, ast.Name) and is_list(self.current.lookup(obj.id)) and arg_types:
+                self.refine(obj.id, list_of(arg_types[0]))
+                return "None"
+            t = self.expr(obj)
+            if t == "file":
+                return { "readline": "str", "read": "str", "close": "None" }.get(call.func.attr, Unknown)
+            if t == "dict":
+                return "None" if call.func.attr in ("clear", "update") else Any
+            if t == "set":
+                return { "add": "None", "discard": "None", "remove": "None", "clear": "None" }.get(call.func.attr, Unknown)
+            return Unknown
+
+        if not isinstance(call.func, ast.Name):
+            return Unknown
+
+        name = call.func.id
+        if name in self.definitions:
+            arg_types = [self.expr(arg) for arg in resolve_arguments(self.definitions[name], call)]
+            callee = self.specialize(name, arg_types)
+            return callee.returns if callee else Unknown
+
+        if name in ("sum", "min", "max") and arg_types:
+            if len(arg_types) > 1:
+                result = Unknown
+                for t in arg_types:
+                    result = unify(result, t)
+                return result
+            t = arg_types[0]
+            element = iterated_type(t) if is_list(t) or is_generator(t) or t == "range" else Unknown
+            return "int" if name == "sum" and element == "bool" else element
+
+        builtins = { "len": "int", "any": "bool", "all": "bool", "str": "str", "range": "range", "print": "None", "open": "file", "input": "str", "dict": "dict", "set": "set" }
+        return builtins.get(name, Unknown)
+
+    def lookup(self, name: str) -> str:
+        for scope in reversed(self.scopes):
+            if name in scope:
+                return scope[name]
+        return self.current.lookup(name)
+
+    @contextlib.contextmanager
+    def scope(self, comprehension: ast.comprehension):
+        "Binds targets of comprehension to elements of its iterable, for expressions inside it"
+        element = iterated_type(self.expr(comprehension.iter))
+        self.scopes.append({ name: element for name in target_names(comprehension.target) })
+        try:
+            for condition in comprehension.ifs:
+                self.expr(condition)
+            yield
+        finally:
+            self.scopes.pop()
+
+    def expr(self, expr: ast.expr) -> str:
+        if isinstance(expr, ast.Constant):
+            val = expr.value
+            if val is None:           return "None"
+            if isinstance(val, bool): return "bool"
+            if isinstance(val, int):  return "int"
+            if isinstance(val, str):  return "str"
+            return Any
+        if isinstance(expr, ast.Name):
+            return self.lookup(expr.id)
+        if isinstance(expr, (ast.ListComp, ast.SetComp, ast.GeneratorExp, ast.DictComp)):
+            # Each for clause sees targets of the previous ones
+            with contextlib.ExitStack() as scopes:
+                for comprehension in expr.generators:
+                    scopes.enter_context(self.scope(comprehension))
+                if isinstance(expr, ast.DictComp):
+                    self.expr(expr.key)
+                    self.expr(expr.value)
+                    return "dict"
+                element = self.expr(expr.elt)
+            if isinstance(expr, ast.ListComp): return list_of(element)
+            if isinstance(expr, ast.SetComp):  return "set"
+            return generator_of(element)
+        if isinstance(expr, ast.BinOp):
+            return self.binop(expr.op, self.expr(expr.left), self.expr(expr.right))
+        if isinstance(expr, ast.UnaryOp):
+            t = self.expr(expr.operand)
+            return "int" if t in ("int", "bool") else t
+        if isinstance(expr, ast.Compare):
+            self.expr(expr.left)
+            for comparator in expr.comparators:
+                self.expr(comparator)
+            return "bool"
+        if isinstance(expr, ast.IfExp):
+            self.expr(expr.test)
+            return unify(self.expr(expr.body), self.expr(expr.orelse))
+        if isinstance(expr, ast.Call):
+            return self.call(expr)
+        if isinstance(expr, ast.List):
+            element = Unknown
+            for elt in expr.elts:
+                element = unify(element, self.expr(elt))
+            return list_of(element)
+        if isinstance(expr, (ast.Dict, ast.Set)):
+            for part in (*getattr(expr, "keys", ()), *getattr(expr, "values", ()), *getattr(expr, "elts", ())):
+                if part is not None:
+                    self.expr(part)
+            return "dict" if isinstance(expr, ast.Dict) else "set"
+        if isinstance(expr, ast.Subscript):
+            container = self.expr(expr.value)
+            self.expr(expr.slice)
+            if isinstance(expr.slice, ast.Slice) and is_list(container): return container
+            if is_list(container): return element_type(container)
+            if container == "str": return "str"
+            return Unknown if container == Unknown else Any
+        if isinstance(expr, ast.Attribute):
+            if is_stdin(expr):
+                return "file"
+            self.expr(expr.value)
+        return Unknown
+
+# Operators that are folded at compile time, with their Python semantics
+folded_operators = {
+    ast.Add: lambda a, b: a + b, ast.Sub: lambda a, b: a - b, ast.Mult: lambda a, b: a * b,
+    # Modulo by zero is raised at runtime
+    ast.Mod: lambda a, b: a % b if b else None,
+    ast.Lt: lambda a, b: a < b, ast.LtE: lambda a, b: a <= b, ast.Gt: lambda a, b: a > b,
+    ast.GtE: lambda a, b: a >= b, ast.Eq: lambda a, b: a == b, ast.NotEq: lambda a, b: a != b,
+}
+
+# Maximum number of lines executed by a call evaluated at compile time,
+# more expensive calls are left for runtime, like in constexpr evaluation
+evaluation_budget = 100_000
+
+class Evaluation_Budget_Exceeded(Exception):
+    pass
+
+class Pure_Functions:
+    """
+    Functions only operating on int and bool values, without side effects.
+    Their calls with constant arguments are evaluated at compile time by
+    the interpreter, which has the same semantics as compiled code.
+    """
+    def __init__(self, definitions: dict[str, ast.FunctionDef]):
+        # Functions are assumed pure, until they are found calling impure ones
+        self.names = set(definitions)
+        while impure := { name for name in self.names if not self.is_pure(definitions[name]) }:
+            self.names -= impure
+
+        self.namespace = {}
+        module = ast.Module(body=[definitions[name] for name in sorted(self.names)], type_ignores=[])
+        exec(compile(module, "<compy>", "exec"), self.namespace)
+
+        # Results of evaluated calls, None when call can't be evaluated
+        self.results : dict[tuple, int | bool | None] = {}
+
+    def is_pure(self, fun: ast.FunctionDef) -> bool:
+        allowed = (ast.Name, ast.expr_context,
+            ast.Assign, ast.AnnAssign, ast.AugAssign, ast.While, ast.Return, ast.Break, ast.Continue,
+            ast.IfExp, ast.BinOp, ast.UnaryOp, ast.USub, ast.Compare, *folded_operators)
+        for node in (n for stmt in fun.body for n in ast.walk(stmt)):
+            if isinstance(node, ast.Constant):
+                if type(node.value) not in (int, bool):
+                    return False
+            elif isinstance(node, ast.For):
+                if not (isinstance(node.iter, ast.Call) and isinstance(node.iter.func, ast.Name) and node.iter.func.id == "range"):
+                    return False
+            elif isinstance(node, ast.Call):
+                if not (isinstance(node.func, ast.Name) and (node.func.id in self.names or node.func.id == "range")):
+                    return False
+            elif not isinstance(node, allowed):
+                return False
+        return True
+
+    def evaluate(self, name: str, args: tuple) -> int | bool | None:
+        "Result of call, None when it raises or exceeds evaluation budget"
+        key = (name, *((type(arg), arg) for arg in args))
+        if key not in self.results:
+            self.results[key] = None
+            lines = 0
+            def trace(frame, event, arg):
+                nonlocal lines
+                lines += 1
+                if lines > evaluation_budget:
+                    raise Evaluation_Budget_Exceeded()
+                return trace
+
+            previous = sys.gettrace()
+            sys.settrace(trace)
+            try:
+                result = self.namespace[name](*args)
+                if type(result) in (int, bool):
+                    self.results[key] = result
+            except Exception:
+                pass
+            finally:
+                sys.settrace(previous)
+        return self.results[key]
+
+class Constant_Folding(ast.NodeTransformer):
+    """
+    Replaces expressions that can be computed at compile time by constants,
+    including calls of pure functions with constant arguments
+    """
+    def __init__(self, definitions: dict[str, ast.FunctionDef]):
+        self.definitions = definitions
+        self.pure_functions = Pure_Functions(definitions)
+
+    def constant(self, expr: ast.expr) -> int | bool | None:
+        "Value of expression that can be computed at compile time"
+        if isinstance(expr, ast.Constant):
+            return expr.value if type(expr.value) in (int, bool) else None
+        if isinstance(expr, ast.UnaryOp) and isinstance(expr.op, ast.USub):
+            value = self.constant(expr.operand)
+            return None if value is None else -value
+        if isinstance(expr, ast.BinOp) and type(expr.op) in folded_operators:
+            lhs, rhs = self.constant(expr.left), self.constant(expr.right)
+            return None if lhs is None or rhs is None else folded_operators[type(expr.op)](lhs, rhs)
+        if isinstance(expr, ast.Compare) and len(expr.ops) == 1 and type(expr.ops[0]) in folded_operators:
+            lhs, rhs = self.constant(expr.left), self.constant(expr.comparators[0])
+            return None if lhs is None or rhs is None else folded_operators[type(expr.ops[0])](lhs, rhs)
+        if isinstance(expr, ast.Call) and isinstance(expr.func, ast.Name) and expr.func.id in self.pure_functions.names:
+            args = [self.constant(arg) for arg in resolve_arguments(self.definitions[expr.func.id], expr)]
+            return None if None in args else self.pure_functions.evaluate(expr.func.id, tuple(args))
+        return None
+
+    def visit(self, node: ast.AST):
+        if isinstance(node, (ast.BinOp, ast.UnaryOp, ast.Compare, ast.Call)):
+            value = self.constant(node)
+            # Big integers are parsed from decimal at startup anyway
+            if isinstance(value, bool) or (value is not None and -2**63 < value < 2**63):
+                return ast.copy_location(ast.Constant(value), node)
+        return super().visit(node)
+
+class Iterator_Builtins(ast.NodeTransformer):
+    """
+    Rewrites calls of map() and filter() into generator expressions, and
+    list() and set() of generator expressions into comprehensions, so all
+    of them are compiled into the same lazy generators
+    """
+    def __init__(self, definitions: set[str]):
+        # Functions defined by program, which hide builtins
+        self.definitions = definitions
+
+    def application(self, function: ast.expr, iterable: ast.expr) -> tuple[ast.comprehension, ast.expr]:
+        "Clause iterating over iterable and call of function with its element"
+        if isinstance(function, ast.Lambda):
+            args = function.args
+            assert len(args.args) == 1 and not (args.posonlyargs or args.kwonlyargs or args.vararg or args.kwarg or args.defaults), \
+                "Only lambdas with single argument are supported by map() and filter()"
+            name, value = args.args[0].arg, function.body
+        else:
+            name, value = "compy_element", ast.Call(function, [ast.Name("compy_element", ast.Load())], [])
+        return ast.comprehension(ast.Name(name, ast.Store()), iterable, [], 0), value
+
+    def visit_Call(self, call: ast.Call):
+        self.generic_visit(call)
+        if not isinstance(call.func, ast.Name) or call.func.id in self.definitions or call.keywords:
+            return call
+        name, args = call.func.id, call.args
+        if name in ("map", "filter"):
+            assert len(args) == 2, f"Only {name}() of single iterable is supported yet"
+            function, iterable = args
+            if name == "filter" and isinstance(function, ast.Constant) and function.value is None:
+                clause, value = ast.comprehension(ast.Name("compy_element", ast.Store()), iterable, [], 0), ast.Name("compy_element", ast.Load())
+            else:
+                clause, value = self.application(function, iterable)
+            if name == "filter":
+                clause.ifs, value = [value], ast.Name(clause.target.id, ast.Load())
+            return ast.copy_location(ast.GeneratorExp(value, [clause]), call)
+        if name in ("list", "set") and len(args) == 1 and isinstance(args[0], ast.GeneratorExp):
+            comprehension = ast.ListComp if name == "list" else ast.SetComp
+            return ast.copy_location(comprehension(args[0].elt, args[0].generators), call)
+        return call
 
-codegen = Code_Generator()
+class Visitor(ast.NodeVisitor):
+    def __init__(self, inference: Type_Inference, codegen: Code_Generator):
+        self.inference = inference
+        self.codegen = codegen
+        self.types = inference.result
+        self.current = self.types["compy_main"][0]
 
-def cpp_str(s: str) -> str:
-    return '"%s"_str' % (s,)
+        # Current block allocates temporaries from arena
+        self.uses_arena = False
 
-def cpp_int(i: int) -> str:
-    return "%d" % (i,)
+        # Body of current function, or of module
+        self.function_body = []
+
+        # Ids of Name nodes that are last uses of their variables in current function
+        self.last_uses = set()
+
+        # Temporaries can be allocated from arena in current context.
+        # Loop headers are evaluated repeatedly, so they can't use it.
+        self.arena_allowed = True
+
+        # Function compiled as loop with its final return, see recursion_loop()
+        self.recursion: tuple[ast.FunctionDef, ast.Return, type | None] | None = None
+
+        # Variables of counted loops declared as python::Int, see range_loop()
+        self.native_variables: set[str] = set()
+
+    def type_of(self, expr: ast.expr) -> str:
+        self.inference.current = self.current
+        return self.inference.expr(expr)
 
-class Visitor(ast.NodeVisitor):
     def generic_visit(self, node: ast.AST):
         classname = node.__class__.__name__
         line, column = node.lineno, node.col_offset
@@ -97,18 +1224,90 @@ class Visitor(ast.NodeVisitor):
         print(ast.dump(node, indent=2), file=sys.stderr, flush=True)
         exit(1)
 
-    def add_statement(self, stmt):
+    def add_statement(self, stmt, source: ast.stmt | None = None):
         if stmt is not None:
-            codegen.add_statement(stmt)
+            self.codegen.add_statement(stmt, source)
 
     def block(self, statements):
+        start, outer = self.codegen.mark(), self.uses_arena
+        self.uses_arena = False
         for statement in statements:
-            self.add_statement(self.visit(statement))
-
+            self.add_statement(self.visit(statement), statement)
+        if self.uses_arena:
+            self.codegen.insert_statement(start, "python::Arena compy_arena")
+        self.uses_arena = outer
+
+    def loop_header(self, expr: ast.expr) -> str:
+        allowed, self.arena_allowed = self.arena_allowed, False
+        result = self.visit(expr)
+        self.arena_allowed = allowed
+        return result
+
+    def visit_temporary(self, expr: ast.expr) -> str:
+        """
+        Visits expression which value doesn't escape the statement that it belongs to,
+        allocating typed lists built from literals from the arena of current block
+        """
+        if not (arena_mode and self.arena_allowed and element_type(self.type_of(expr)) in typed_list_elements):
+            return self.visit(expr)
+
+        if isinstance(expr, ast.List):
+            self.uses_arena = True
+            elements = ''.join(', ' + self.visit(element) for element in expr.elts)
+            return "%s::init(&compy_arena%s)" % (cpp_type(self.type_of(expr)), elements)
+
+        if isinstance(expr, ast.BinOp) and isinstance(expr.op, (ast.Add, ast.Mult)):
+            o = "+" if isinstance(expr.op, ast.Add) else "*"
+            return "(%s) %s (%s)" % (self.visit_temporary(expr.left), o, self.visit_temporary(expr.right))
+
+        return self.visit(expr)
+
+    def visit_iterable(self, expr: ast.expr) -> str:
+        "Visits iterated expression, which may be generator expression"
+        return self.generator(expr) if isinstance(expr, ast.GeneratorExp) else self.visit(expr)
+
+    def generator(self, expr: ast.ListComp | ast.SetComp | ast.GeneratorExp) -> str:
+        """
+        Lowers comprehension into python::Generator, which computes elements
+        lazily inside the loop consuming it, so chains of generators fuse into
+        single loop without temporary lists
+        """
+        assert len(expr.generators) == 1, "Comprehensions with multiple for clauses are not supported yet"
+        clause = expr.generators[0]
+        assert isinstance(clause.target, ast.Name), "Unpacking in comprehensions is not supported yet"
+        assert not clause.is_async, "Asynchronous comprehensions are not supported"
+
+        source, name, iterated = self.visit_iterable(clause.iter), clause.target.id, self.type_of(clause.iter)
+        allowed, self.arena_allowed = self.arena_allowed, False
+        with self.inference.scope(clause):
+            t = self.type_of(clause.target)
+            # Lines are copied out of reader's buffer like by for loops
+            if iterated == "file":
+                param, prologue = "std::string_view compy_line", "python::Str %s(compy_line); " % (name,)
+            else:
+                # Native integers are widened, other elements are bound like targets of for loops
+                param, prologue = "%s %s" % ({ "int": "python::Integer", "bool": "bool" }.get(t, "auto const&"), name), ""
+
+            if clause.ifs:
+                conditions = ' && '.join("bool(%s)" % (self.visit(condition),) for condition in clause.ifs)
+                predicate = "[&](%s) -> bool { %sreturn %s; }" % (param, prologue, conditions)
+            else:
+                predicate = "python::Always{}"
+
+            element, t = self.visit(expr.elt), self.type_of(expr.elt)
+            value = element if t in (Unknown, Any) else "%s(%s)" % (cpp_type(t), element)
+            function = "[&](%s) { %sreturn %s; }" % (param, prologue, value)
+        self.arena_allowed = allowed
+        return Expression("python::generator(%s, %s, %s)" % (source, predicate, function), postfix_precedence)
 
     def visit_Module(self, module: ast.Module):
-        codegen.enter_function('compy_main')
-        with codegen.in_function("compy_main"):
+        self.codegen.enter_function('compy_main')
+        self.codegen.locals["compy_main"] = self.current.declarations()
+        self.codegen.types["compy_main"] = self.current
+        self.codegen.sources["compy_main"] = module.body
+        with self.codegen.in_function("compy_main"):
+            self.last_uses = last_uses(module.body, self.movable_variables(set()))
+            self.function_body = module.body
             self.block(module.body)
 
     def visit_FunctionDef(self, fun: ast.FunctionDef):
@@ -118,58 +1317,480 @@ class Visitor(ast.NodeVisitor):
         assert not fun.args.kw_defaults, "Arguments are not supported yet"
         assert not fun.args.defaults,    "Arguments are not supported yet"
 
-        if fun.returns:
-            assert isinstance(fun.returns, ast.Name), "Only type names are supported now"
-            codegen.return_types[fun.name] = fun.returns.id
-
-        codegen.args[fun.name] = [a.arg for a in fun.args.args]
-        with codegen.in_function(fun.name):
-            for statement in fun.body:
-                self.add_statement(self.visit(statement))
+        main = self.current
+        specializations = self.types[fun.name]
+        for types in specializations:
+            self.current = types
+            loop = self.recursion_loop(fun)
+
+            # Arguments that are only read are passed by reference, unless recursion rebinds them
+            by_reference = { arg for arg, t in types.args.items() if is_movable(t) and not mutates(arg, fun.body) }
+            if loop is not None:
+                by_reference -= loop[1]
+            args = [f"{cpp_type(t)} const& {arg}" if arg in by_reference else f"{cpp_type(t)} {arg}" for arg, t in types.args.items()]
+            if len(specializations) == 1:
+                name = fun.name
+            else:
+                name = "%s(%s)" % (fun.name, ', '.join(cpp_type(t) for t in types.args.values()))
+                self.codegen.cpp_names[name] = fun.name
+                # Different inferred types may result in the same C++ signature
+                if name in self.codegen.args:
+                    continue
+
+            self.codegen.lines[name] = fun.lineno
+            self.codegen.return_types[name] = "void" if types.returns == "None" else cpp_type(types.returns)
+            self.codegen.args[name] = args
+            self.codegen.locals[name] = types.declarations()
+            self.codegen.types[name] = types
+            self.codegen.sources[name] = fun.body
+
+            with self.codegen.in_function(name):
+                self.last_uses = last_uses(fun.body, self.movable_variables(by_reference))
+                self.function_body = fun.body
+                if loop is None:
+                    self.block(fun.body)
+                    continue
+                op, _ = loop
+                if op is not None:
+                    self.add_statement("python::Integer compy_accumulator = %d" % (int(op is ast.Mult),))
+                self.recursion = (fun, fun.body[-1], op)
+                self.codegen.begin_block("for (;;)")
+                self.block(fun.body)
+                self.codegen.end_block()
+                self.recursion = None
+        self.current = main
+
+    def is_self_call(self, expr: ast.expr, fun: ast.FunctionDef) -> bool:
+        return isinstance(expr, ast.Call) and isinstance(expr.func, ast.Name) and expr.func.id == fun.name
+
+    def accumulation(self, expr: ast.expr, fun: ast.FunctionDef) -> tuple[ast.expr, ast.expr] | None:
+        "Recursive side and the other operand of `x + f(...)` or `f(...) * x`"
+        if not (isinstance(expr, ast.BinOp) and isinstance(expr.op, (ast.Add, ast.Mult))):
+            return None
+        recursive = lambda e: any(self.is_self_call(n, fun) for n in ast.walk(e))
+        for call, operand in ((expr.left, expr.right), (expr.right, expr.left)):
+            if recursive(call) and not recursive(operand):
+                return call, operand
+        return None
+
+    def recursion_loop(self, fun: ast.FunctionDef) -> tuple[type | None, set[str]] | None:
+        """
+        Whether current specialization of function can run as loop, instead of
+        using stack frame per call: its final return selects by conditional
+        expressions either value without recursion or call of itself, which
+        rebinds parameters. Calls of int functions may be accumulated like
+        `n * f(n - 1)`, by single associative operator and operands without
+        calls of user functions. Returns the operator, None without
+        accumulation, and parameters that calls rebind.
+        """
+        types = self.current
+        if types.returns in ("None", Unknown) or not fun.body or not isinstance(fun.body[-1], ast.Return) or fun.body[-1].value is None:
+            return None
+        params = [arg.arg for arg in fun.args.args]
+        recursive = lambda e: any(self.is_self_call(n, fun) for n in ast.walk(e))
+        ops, bases, calls, rebound = set(), [], [], set()
+
+        def loops(expr: ast.expr) -> bool:
+            if isinstance(expr, ast.IfExp):
+                return not recursive(expr.test) and loops(expr.body) and loops(expr.orelse)
+            if self.is_self_call(expr, fun):
+                args = resolve_arguments(fun, expr)
+                # Other specializations are called with arguments of other types
+                if len(self.types[fun.name]) > 1 and [self.type_of(arg) for arg in args] != list(types.args.values()):
+                    return False
+                calls.append(expr)
+                rebound.update(p for p, arg in zip(params, args) if not (isinstance(arg, ast.Name) and arg.id == p))
+                return not any(recursive(arg) for arg in args)
+            if accumulation := self.accumulation(expr, fun):
+                call, operand = accumulation
+                impure = any(isinstance(n, ast.Call) and not (isinstance(n.func, ast.Name) and n.func.id in read_only_builtins) for n in ast.walk(operand))
+                ops.add(type(expr.op))
+                return types.returns == "int" and self.type_of(operand) == "int" and not impure and loops(call)
+            bases.append(expr)
+            return not recursive(expr)
+
+        if not loops(fun.body[-1].value) or not calls:
+            return None
+        if len(ops) > 1 or (ops and any(self.type_of(base) != "int" for base in bases)):
+            return None
+        return next(iter(ops), None), rebound
+
+    def movable_variables(self, by_reference: set[str]) -> set[str]:
+        "Variables of current function that own their values"
+        variables = { *self.current.args, *self.current.locals } - self.current.loop_variables - by_reference
+        return { name for name in variables if is_movable(self.current.lookup(name)) }
 
     def visit_Assign(self, assign: ast.Assign):
         assert len(assign.targets) == 1, "Multiple targets are not supported yet"
 
+        target = assign.targets[0]
+        if isinstance(target, ast.Subscript) and self.type_of(target.value) == "dict":
+            if update := self.dict_update(target, assign.value):
+                default, increment = update
+                return "(%s).setdefault(%s, %s) += %s" % (self.visit(target.value), self.visit(target.slice), self.visit(default), self.visit(increment))
+            return "(%s).set(%s, %s)" % (self.visit(target.value), self.visit(target.slice), self.visit(assign.value))
+
         return "%s = %s" % (
             self.visit(assign.targets[0]),
-            self.visit(assign.value))
+            self.assigned_value(assign.targets[0], assign.value))
+
+    def dict_update(self, target: ast.Subscript, value: ast.expr) -> tuple[ast.expr, ast.expr] | None:
+        """
+        Default and increment of `d[k] = d.get(k, default) + increment`, which
+        looks key up once as `d.setdefault(k, default) += increment`. Increment
+        is evaluated first then, so it must not refer to d, and default must
+        not have side effects.
+        """
+        if not (isinstance(target.value, ast.Name) and isinstance(target.slice, (ast.Name, ast.Constant))
+                and isinstance(value, ast.BinOp) and isinstance(value.op, ast.Add)):
+            return None
+        get, name = value.left, target.value.id
+        if not (isinstance(get, ast.Call) and isinstance(get.func, ast.Attribute) and get.func.attr == "get"
+                and isinstance(get.func.value, ast.Name) and get.func.value.id == name
+                and len(get.args) == 2 and not get.keywords and ast.dump(get.args[0]) == ast.dump(target.slice)):
+            return None
+        default, increment = get.args[1], value.right
+        if any(isinstance(n, ast.Call) for n in ast.walk(default)) \
+                or any(isinstance(n, ast.Name) and n.id == name for part in (default, increment) for n in ast.walk(part)):
+            return None
+        return default, increment
 
     def visit_AnnAssign(self, assign: ast.AnnAssign):
-        return "%s %s = %s" % (
-                assign.annotation.id,
-                assign.target.id,
-                self.visit(assign.value)
-        )
+        # Variable is already declared at the top of the function
+        if assign.value is not None:
+            return "%s = %s" % (assign.target.id, self.assigned_value(assign.target, assign.value))
+
+    def assigned_value(self, target: ast.expr, value: ast.expr) -> str:
+        # Empty list literal takes type of list that it's assigned to
+        if isinstance(value, ast.List) and not value.elts and is_list(self.type_of(target)):
+            return "{}"
+        return self.visit(value)
 
     def visit_AugAssign(self, assign: ast.AugAssign):
         if   isinstance(assign.op, ast.Add):  op ="+"
+        elif isinstance(assign.op, ast.Sub):  op = "-"
         elif isinstance(assign.op, ast.Mult): op = "*"
+        elif isinstance(assign.op, ast.Mod):  op = "%"
         else:
             assert False, "Unsuported operation: " + ast.dump(assign.op)
 
-        return "%s %s= %s" % (self.visit(assign.target), op, self.visit(assign.value))
+        # Elements of right hand side are copied into target list
+        value = self.visit_temporary(assign.value) if is_list(self.type_of(assign.target)) else self.visit(assign.value)
+        return "%s %s= %s" % (self.visit(assign.target), op, value)
+
+    def profiled_loop(self, loop: ast.For | ast.While, emit):
+        "Emits loop, measured by its own timer in profile mode"
+        if not profile_mode:
+            return emit(loop)
+        kind = "for" if isinstance(loop, ast.For) else "while"
+        self.codegen.begin_block("")
+        for stmt in profile_timer(f"{kind} loop in {python_name(self.codegen.names[-1])}", loop.lineno):
+            self.add_statement(stmt)
+        emit(loop)
+        self.codegen.end_block()
 
     def visit_While(self, w: ast.While):
-        self.add_statement("while (%s) {" % (self.visit(w.test), ))
+        self.profiled_loop(w, self.while_loop)
+
+    def while_loop(self, w: ast.While):
+        self.codegen.begin_block("while (%s)" % (self.loop_header(w.test), ))
         self.block(w.body)
-        self.add_statement("}")
+        self.codegen.end_block()
 
     def visit_For(self, f: ast.For):
-        self.add_statement("for (auto %s : %s) {" % (self.visit(f.target), self.visit(f.iter),))
+        self.profiled_loop(f, self.for_loop)
+
+    def for_loop(self, f: ast.For):
+        if isinstance(f.target, ast.Tuple):
+            return self.items_loop(f)
+        target = self.visit(f.target)
+        if getattr(f, "parallel", False):
+            reason, variables = self.parallel_analysis(f)
+            if reason is None:
+                return self.parallel_loop(f, target, variables)
+            if not silent_mode:
+                print(f"{f.lineno}: loop marked by `# compy: parallel` runs serially, {reason}", file=sys.stderr)
+        if self.is_range_call(f.iter):
+            return self.counted_loop(f, target)
+        if self.type_of(f.iter) == "file" and target in self.current.loop_variables:
+            # Lines are copied out of reader's buffer only when they outlive the iteration
+            if not mutates(target, f.body) and only_viewed(target, f.body, lambda e: self.type_of(e) == "str"):
+                self.codegen.begin_block("for (std::string_view %s : %s)" % (target, self.visit(f.iter),))
+            else:
+                self.codegen.begin_block("for (std::string_view compy_line : %s)" % (self.visit(f.iter),))
+                self.add_statement("python::Str %s(compy_line)" % (target,))
+        elif target in self.current.loop_variables:
+            binding = "auto" if mutates(target, f.body) else "auto const&"
+            self.codegen.begin_block("for (%s %s : %s)" % (binding, target, self.visit_iterable(f.iter),))
+        else:
+            # Target outlives the loop, so it's declared by the function
+            self.codegen.begin_block("for (auto&& compy_it : %s)" % (self.visit_iterable(f.iter),))
+            self.add_statement("%s = compy_it" % (target,))
+        self.block(f.body)
+        self.codegen.end_block()
+
+    def items_loop(self, f: ast.For):
+        "Lowers `for k, v in d.items()`, binding names to key and value of each entry"
+        names = target_names(f.target)
+        assert len(names) == 2 and is_items_call(f.iter) and self.type_of(f.iter.func.value) == "dict", \
+            "Unpacking in for loop is only supported for dict.items()"
+        self.codegen.begin_block("for (auto const& compy_item : %s)" % (self.visit(f.iter),))
+        for name, member in zip(names, ("key", "value")):
+            if name not in self.current.loop_variables:
+                self.add_statement("%s = compy_item.%s" % (name, member))
+            elif mutates(name, f.body):
+                self.add_statement("python::Value %s = compy_item.%s" % (name, member))
+            else:
+                self.add_statement("python::Value const& %s = compy_item.%s" % (name, member))
+        self.block(f.body)
+        self.codegen.end_block()
+
+    def is_range_call(self, expr: ast.expr) -> bool:
+        return (isinstance(expr, ast.Call) and isinstance(expr.func, ast.Name)
+            and expr.func.id == "range" and "range" not in self.inference.definitions
+            and not expr.keywords and 1 <= len(expr.args) <= 3)
+
+    def range_arguments(self, call: ast.Call) -> tuple[str, str, int | None, str]:
+        "Start, stop, step when it's nonzero constant, and C++ expressions of range() call"
+        args = call.args
+        start, stop = ("0", args[0]) if len(args) == 1 else (args[0], args[1])
+        start = start if isinstance(start, str) else self.visit(start)
+        step = constant_int(args[2]) if len(args) == 3 else 1
+        if step == 0:
+            step = None
+        return start, self.visit(stop), step, self.visit(args[2]) if step is None else str(step)
+
+    def counted_loop(self, f: ast.For, target: str):
+        """
+        Lowers for over range() into canonical counted loop, that compilers
+        can unroll and vectorize. Bounds are evaluated only once.
+        """
+        start, stop, step, step_value = self.range_arguments(f.iter)
+        in_bounds = any(isinstance(n, ast.Name) and n.id == target for arg in f.iter.args for n in ast.walk(arg))
+        step_init = "" if step is not None else ", compy_step = python::range_step(%s)" % (step_value,)
+        self.range_loop(f, target, start, stop, step, step_init, in_bounds)
+
+    def range_loop(self, f: ast.For, target: str, start: str, stop: str, step: int | None, step_init: str, in_bounds: bool):
+        "Counted loop with step given by constant or by compy_step variable"
+        # Python rebinds target on each iteration, so assignments to it
+        # in the body can't change the number of iterations
+        body_assigns = any(isinstance(n, ast.Name) and isinstance(n.ctx, ast.Store) and n.id == target
+            for stmt in f.body for n in ast.walk(stmt))
+        direct = target in self.current.loop_variables and not body_assigns and not in_bounds
+        i = target if direct else "compy_i"
+
+        if step is None:
+            condition, increment = "compy_step > 0 ? %s < compy_stop : %s > compy_stop" % (i, i), "compy_step"
+        else:
+            condition, increment = "%s %s compy_stop" % (i, "<" if step > 0 else ">"), str(step)
+
+        self.codegen.begin_block("for (python::Int %s = %s, compy_stop = %s%s; %s; %s += %s)" % (
+            i, start, stop, step_init, condition, i, increment))
+        if not direct:
+            declaration = cpp_type(self.type_of(f.target)) + " " if target in self.current.loop_variables else ""
+            self.add_statement("%s%s = compy_i" % (declaration, target))
+        else:
+            self.native_variables.add(target)
         self.block(f.body)
-        self.add_statement("}")
+        self.native_variables.discard(target)
+        self.codegen.end_block()
+
+    def parallel_analysis(self, f: ast.For) -> tuple[str | None, dict[str, str]]:
+        """
+        Reason why iterations of loop can't run in parallel, or None and variables
+        that each thread keeps on its own: accumulators updated only by `x += e`,
+        `x -= e` or `x *= e` mapped to their operator, and variables private
+        to iterations, which are assigned before they are read, mapped to "".
+        """
+        if not self.is_range_call(f.iter):
+            return "only loops over range() can run in parallel", {}
+        if not isinstance(f.target, ast.Name) or f.target.id not in self.current.loop_variables:
+            return "loop variable is used outside of the loop", {}
+        if f.orelse:
+            return "else clause is not supported", {}
+
+        def nodes(statements, nested_loop=False):
+            "Nodes of statements with flag telling if they are inside of nested loop"
+            for stmt in statements:
+                for child in ast.iter_child_nodes(stmt):
+                    if isinstance(child, ast.stmt):
+                        yield from nodes([child], nested_loop or isinstance(stmt, (ast.For, ast.While)))
+                    else:
+                        yield from ((n, nested_loop) for n in ast.walk(child))
+                yield stmt, nested_loop
+
+        body = [n for n, _ in nodes(f.body)]
+        for node, nested_loop in nodes(f.body):
+            if isinstance(node, ast.Return):
+                return "return from the loop is not supported", {}
+            if isinstance(node, ast.Break) and not nested_loop:
+                return "break is not supported", {}
+
+        outside = { id(n) for n in ast.walk(f) }
+        used_outside = { n.id for stmt in self.function_body for n in ast.walk(stmt)
+            if isinstance(n, ast.Name) and id(n) not in outside }
+
+        variables = {}
+        stored = { n.id for n in body if isinstance(n, ast.Name) and not isinstance(n.ctx, ast.Load) }
+        for name in sorted(stored - self.current.loop_variables):
+            uses = [n for n in body if isinstance(n, ast.Name) and n.id == name]
+            updates = [n for n in body if isinstance(n, ast.AugAssign) and isinstance(n.target, ast.Name) and n.target.id == name]
+            ops = { type(n.op) for n in updates }
+            t = self.current.lookup(name)
+            if updates and len(uses) == len(updates) and (ops <= { ast.Add, ast.Sub } or ops == { ast.Mult }) \
+                    and (t == "int" or (ops == { ast.Add } and (t == "str" or is_list(t)))):
+                variables[name] = "*" if ops == { ast.Mult } else "+"
+                continue
+            first = next(stmt for stmt in f.body if any(isinstance(n, ast.Name) and n.id == name for n in ast.walk(stmt)))
+            assigned_first = isinstance(first, (ast.Assign, ast.AnnAssign)) and first.value is not None \
+                and all(isinstance(target, ast.Name) and target.id == name for target in (first.targets if isinstance(first, ast.Assign) else [first.target])) \
+                and not any(isinstance(n, ast.Name) and n.id == name for n in ast.walk(first.value))
+            if name in used_outside or not assigned_first:
+                return f"variable {name} is shared between iterations", {}
+            variables[name] = ""
+
+        # Each iteration may only access items of lists that it assigns at its own index,
+        # which is distinct from indices of other iterations unless it's negative
+        target, args = f.target.id, f.iter.args
+        step = constant_int(args[2]) if len(args) == 3 else 1
+        bound = constant_int(args[0] if step is not None and step > 0 else args[1]) if len(args) > 1 else 0
+        nonnegative = step is not None and bound is not None and bound >= (0 if step > 0 else -1)
+        rebinds_target = any(isinstance(n, ast.Name) and n.id == target and not isinstance(n.ctx, ast.Load) for n in body)
+        assigned = { n.value.id for n in body if isinstance(n, ast.Subscript) and not isinstance(n.ctx, ast.Load)
+            and isinstance(n.value, ast.Name) and is_list(self.current.lookup(n.value.id)) and n.value.id not in variables }
+        for name in sorted(assigned):
+            uses = [n for n in body if isinstance(n, ast.Name) and n.id == name]
+            items = [n for n in body if isinstance(n, ast.Subscript) and isinstance(n.value, ast.Name) and n.value.id == name]
+            if len(items) != len(uses) or rebinds_target or not all(isinstance(n.slice, ast.Name) and n.slice.id == target for n in items):
+                return f"items of {name} are accessed at other indices than {target}", {}
+            if not nonnegative:
+                return f"indices of {name} may be negative", {}
+
+        # Methods like append() modify values shared by iterations
+        for node in body:
+            if isinstance(node, ast.Subscript) and not isinstance(node.ctx, ast.Load) and isinstance(node.value, ast.Name) \
+                    and not is_list(self.current.lookup(node.value.id)) and node.value.id not in variables:
+                return f"items of {node.value.id} are assigned", {}
+            if isinstance(node, ast.Attribute) and isinstance(node.value, ast.Name) and node.value.id not in variables \
+                    and node.value.id not in self.current.loop_variables:
+                return f"methods of {node.value.id} are called", {}
+        return None, variables
+
+    def parallel_loop(self, f: ast.For, target: str, variables: dict[str, str]):
+        """
+        Lowers for over range() into chunks run by python::parallel pool.
+        Each chunk accumulates into its own partial results, which are
+        combined in order of chunks after the loop.
+        """
+        start, stop, step, step_value = self.range_arguments(f.iter)
+        step_init = "" if step is not None else ", compy_step = python::range_step(%s)" % (step_value,)
+        self.codegen.begin_block("")
+        self.add_statement("python::Int compy_start = %s, compy_stop = %s%s" % (start, stop, step_init))
+        self.add_statement("python::parallel::Chunks const compy_chunks(compy_start, compy_stop, %s)" % ("compy_step" if step is None else step,))
+        accumulators = { name: op for name, op in variables.items() if op }
+        for name in accumulators:
+            self.add_statement("std::vector<%s> compy_partial_%s(compy_chunks.count)" % (cpp_type(self.current.lookup(name)), name))
+
+        # Index of chunk only selects partial results
+        chunk = "std::size_t compy_chunk" if accumulators else "std::size_t"
+        self.codegen.begin_block("compy_chunks.run([&](%s, python::Int compy_from, python::Int compy_to)" % (chunk,), close="});")
+        for name, op in variables.items():
+            self.add_statement("%s %s%s" % (cpp_type(self.current.lookup(name)), name, " = 1" if op == "*" else "{}"))
+        self.range_loop(f, target, "compy_from", "compy_to", step, "", False)
+        for name in accumulators:
+            self.add_statement("compy_partial_%s[compy_chunk] = std::move(%s)" % (name, name))
+        self.codegen.end_block()
+
+        for name, op in accumulators.items():
+            self.add_statement("for (auto &compy_partial : compy_partial_%s) %s %s= std::move(compy_partial)" % (name, name, op))
+        self.codegen.end_block()
 
     def visit_Return(self, ret: ast.Return):
+        if self.recursion is not None and ret is self.recursion[1]:
+            fun, _, op = self.recursion
+            return self.recursion_branch(ret.value, fun, op)
+        if self.current.returns == "None":
+            return "return"
         return "return " + self.visit(ret.value)
 
+    def recursion_branch(self, expr: ast.expr, fun: ast.FunctionDef, op: type | None):
+        "Emits part of final return of function compiled as loop by recursion_loop()"
+        if isinstance(expr, ast.IfExp):
+            self.codegen.begin_block("if (%s)" % (self.visit(expr.test),))
+            self.recursion_branch(expr.body, fun, op)
+            self.codegen.end_block()
+            self.codegen.begin_block("else")
+            self.recursion_branch(expr.orelse, fun, op)
+            self.codegen.end_block()
+        elif self.is_self_call(expr, fun):
+            params = [arg.arg for arg in fun.args.args]
+            rebound = [
+                (param, arg) for param, arg in zip(params, resolve_arguments(fun, expr))
+                if not (isinstance(arg, ast.Name) and arg.id == param)
+            ]
+            # Rebound parameters are dead after evaluation of arguments, so their single reads
+            # move, like `s` in `f(s + x, n - 1)`. Arguments may refer to parameters, so all
+            # are evaluated before any is rebound.
+            reads = [n for _, arg in rebound for n in ast.walk(arg) if isinstance(n, ast.Name)]
+            for param, _ in rebound:
+                uses = [n for n in reads if n.id == param]
+                if len(uses) == 1 and is_movable(self.current.args[param]):
+                    self.last_uses.add(id(uses[0]))
+            for param, arg in rebound:
+                self.add_statement("%s compy_next_%s = %s" % (cpp_type(self.current.args[param]), param, self.visit(arg)))
+            for param, _ in rebound:
+                self.add_statement("%s = std::move(compy_next_%s)" % (param, param))
+            self.add_statement("continue")
+        elif accumulation := self.accumulation(expr, fun):
+            call, operand = accumulation
+            o = "*" if op is ast.Mult else "+"
+            self.add_statement("compy_accumulator = (compy_accumulator) %s (%s)" % (o, self.visit(operand)))
+            self.recursion_branch(call, fun, op)
+        elif op is not None:
+            o = "*" if op is ast.Mult else "+"
+            self.add_statement("return (compy_accumulator) %s (%s)" % (o, self.visit(expr)))
+        else:
+            self.add_statement("return " + self.visit(expr))
+
     def visit_Expr(self, expr: ast.Expr):
         return self.visit(expr.value)
 
     def visit_Subscript(self, expr: ast.Subscript):
-        return "%s[%s]" % (self.visit(expr.value), self.visit(expr.slice))
+        value = operand(self.visit(expr.value), unary_precedence)
+        # Missing keys raise KeyError, instead of being inserted like by std::map
+        if self.type_of(expr.value) == "dict":
+            return Expression("%s.at(%s)" % (value, self.visit(expr.slice)), postfix_precedence)
+        if isinstance(expr.slice, ast.Slice):
+            t = self.type_of(expr.value)
+            assert t == "str" or is_list(t), f"Slicing of {t} is not supported yet"
+            return Expression("%s.slice(%s)" % (value, self.visit(expr.slice)), postfix_precedence)
+        item = "%s[%s]" % (value, self.visit(expr.slice))
+        # Items of typed lists of integers are read through reference, which converts to python::Integer
+        if isinstance(expr.ctx, ast.Load) and self.type_of(expr.value) == list_of("int"):
+            item = "python::Integer(%s)" % (item,)
+        return Expression(item, postfix_precedence)
+
+    def visit_Slice(self, s: ast.Slice):
+        "Bounds of slice, which are omitted when they're missing or None"
+        bounds = [
+            ".%s = %s" % (name, self.visit(bound))
+            for name, bound in (("start", s.lower), ("stop", s.upper), ("step", s.step))
+            if bound is not None and not (isinstance(bound, ast.Constant) and bound.value is None)
+        ]
+        return "python::Slice{%s}" % (', '.join(bounds),)
+
+    def visit_Delete(self, delete: ast.Delete):
+        for target in delete.targets:
+            assert isinstance(target, ast.Subscript) and self.type_of(target.value) == "dict", "Only del of dict items is supported yet"
+            self.add_statement("(%s).erase(%s)" % (self.visit(target.value), self.visit(target.slice)))
 
     def visit_IfExp(self, expr: ast.IfExp):
-        return "(%s) ? (%s) : (%s)" % tuple(self.visit(x) for x in (expr.test, expr.body, expr.orelse))
+        test, body, orelse = (self.visit(x) for x in (expr.test, expr.body, expr.orelse))
+        t = self.type_of(expr)
+        if t not in (Unknown, Any):
+            # Branches of different C++ types, like literal and python::Integer, have no common type
+            return "(%s) ? %s(%s) : %s(%s)" % (test, cpp_type(t), body, cpp_type(t), orelse)
+        return "(%s) ? (%s) : (%s)" % (test, body, orelse)
 
     def visit_Compare(self, expr: ast.Compare):
         assert len(expr.comparators) == 1, "Only one comparator is supported now"
@@ -180,90 +1801,551 @@ class Visitor(ast.NodeVisitor):
             o = "<"
         elif isinstance(op, ast.LtE):
             o = "<="
+        elif isinstance(op, ast.Gt):
+            o = ">"
+        elif isinstance(op, ast.GtE):
+            o = ">="
+        elif isinstance(op, ast.Eq):
+            o = "=="
+        elif isinstance(op, ast.NotEq):
+            o = "!="
         elif isinstance(op, ast.In):
-            return "in((%s), (%s))" % (self.visit(lhs), self.visit(rhs))
+            return "in((%s), (%s))" % (self.visit(lhs), self.visit_temporary(rhs))
         else:
             assert False, "unknown comparison operator: " + ast.dump(op, indent=2)
 
-        return "(%s) %s (%s)" % (self.visit(lhs), o, self.visit(rhs))
+        return Expression("%s %s %s" % (
+            operand(self.visit_temporary(lhs), comparison_precedence), o,
+            operand(self.visit_temporary(rhs), comparison_precedence)), comparison_precedence)
 
     def visit_BinOp(self, expr: ast.BinOp):
         lhs, op, rhs = expr.left, expr.op, expr.right
 
-        # TODO Resolve precedense. A good idea is to implement precedense
-        # visitor that based on current op will calculate if operators in
-        # subtree have higher precedense
-        if   isinstance(op, ast.Add):  o = "+"
-        elif isinstance(op, ast.Sub):  o = "-"
-        elif isinstance(op, ast.Mult): o = "*"
+        if   isinstance(op, ast.Add):  o, precedence = "+", additive_precedence
+        elif isinstance(op, ast.Sub):  o, precedence = "-", additive_precedence
+        elif isinstance(op, ast.Mult): o, precedence = "*", multiplicative_precedence
+        elif isinstance(op, ast.Mod):  o, precedence = "%", multiplicative_precedence
         else: assert False, "unknown operator: " + ast.dump(op, indent=2)
-
-        return "(%s) %s (%s)" % (self.visit(lhs), o, self.visit(rhs))
+        assert not (o == "%" and self.type_of(lhs) == "str"), "String formatting with % is not supported yet"
+
+        left = self.visit(lhs)
+        # Only operators of python::Integer check overflow, so one of operands is converted
+        if self.is_native_int(lhs) and self.is_native_int(rhs):
+            left = Expression("python::Integer(%s)" % (left,), postfix_precedence)
+        return Expression("%s %s %s" % (operand(left, precedence, left=True), o, operand(self.visit(rhs), precedence)), precedence)
+
+    def is_native_int(self, expr: ast.expr) -> bool:
+        "Integer compiled to native C++ integer, like literal, variable of counted loop or len()"
+        if isinstance(expr, ast.UnaryOp):
+            expr = expr.operand
+        if isinstance(expr, ast.Name):
+            return expr.id in self.native_variables
+        if isinstance(expr, ast.Call) and isinstance(expr.func, ast.Name):
+            return expr.func.id == "len" and expr.func.id not in self.inference.definitions
+        return isinstance(expr, ast.Constant) and type(expr.value) is int
 
     def visit_UnaryOp(self, expr: ast.UnaryOp):
         if isinstance(expr.op, ast.USub):
-            return "-(%s)" % (self.visit(expr.operand),)
+            return Expression("-%s" % (operand(self.visit(expr.operand), unary_precedence),), unary_precedence)
         assert False, "unsuported type of unary operation: " + ast.dump(expr.op)
 
     def visit_Call(self, call: ast.Call) -> str:
         func = self.visit(call.func)
-        args = [self.visit(arg) for arg in call.args]
-
-        if call.keywords:
+        builtin = isinstance(call.func, ast.Name) and call.func.id not in self.inference.definitions
+        if builtin and call.func.id in ("any", "all"):
+            func = "python::%s_of" % (call.func.id,)
+        if isinstance(call.func, ast.Name) and call.func.id in read_only_builtins:
+            # Generator expression argument is consumed without temporary list
+            consumes = builtin and call.func.id in iterating_builtins and len(call.args) == 1
+            args = [self.generator(arg) if consumes and isinstance(arg, ast.GeneratorExp) else self.visit_temporary(arg) for arg in call.args]
+        else:
+            args = [self.visit(arg) for arg in call.args]
+
+        if isinstance(call.func, ast.Name) and call.func.id in self.inference.definitions:
+            # Keywords are mapped onto parameters at compile time
+            params = resolve_arguments(self.inference.definitions[call.func.id], call)
+            if call.keywords:
+                args = [self.visit(arg) for arg in params]
+            # Native integers convert both to python::Integer and python::Value
+            # taken by different specializations, so they are converted upfront
+            if len(self.types[call.func.id]) > 1:
+                args = [f"python::Integer({arg})" if self.type_of(param) == "int" else arg for arg, param in zip(args, params)]
+        elif call.keywords and isinstance(call.func, ast.Name) and call.func.id == "print":
+            args.insert(0, self.print_options(call.keywords))
+        elif call.keywords:
             kw = "python::Keyword_Arguments{}"
             for keyword in call.keywords:
                 kw += '.append("%s", %s)' % (keyword.arg, self.visit(keyword.value))
             args.insert(0, kw)
 
-        return "%s(%s)" % (func, ', '.join(args))
+        return Expression("%s(%s)" % (func, ', '.join(args)), postfix_precedence)
+
+    def print_options(self, keywords: list[ast.keyword]) -> str:
+        "Initializes python::Printer from keyword arguments of print()"
+        values = {}
+        for keyword in keywords:
+            assert keyword.arg != "file", "File specification for print() function is not implemented yet"
+            assert keyword.arg in print_keywords, f"print() got an unexpected keyword argument '{keyword.arg}'"
+            values[keyword.arg] = keyword.value
+
+        fields = []
+        for name, expected in print_keywords.items():
+            if name not in values or (isinstance(values[name], ast.Constant) and values[name].value is None):
+                continue
+            value, t = values[name], self.type_of(values[name])
+            if t == expected:
+                fields.append(".%s = %s" % (name, self.visit(value)))
+            elif expected == "bool" and t == "int":
+                fields.append(".%s = bool(%s)" % (name, self.visit(value)))
+            elif t != Any:
+                assert False, f"{name} must be None or a {expected}, not {t}"
+            elif expected == "str":
+                fields.append('.%s = python::str_or_none(%s, python::Printer{}.%s, "%s must be None or a string")' % (name, self.visit(value), name, name))
+            else:
+                fields.append(".%s = any(%s).coarce_bool()" % (name, self.visit(value)))
+
+        return "python::Printer{%s}" % (', '.join(fields),)
 
     def visit_Name(self, name: ast.Name) -> str:
-        return name.id
+        if id(name) in self.last_uses:
+            return Expression("std::move(%s)" % (name.id,), postfix_precedence)
+        return Expression(name.id, postfix_precedence)
 
     def visit_Attribute(self, attr: ast.Attribute) -> str:
-        return "(%s).%s" % (self.visit(attr.value), attr.attr)
+        if is_stdin(attr):
+            return Expression("python::sys::standard_input()", postfix_precedence)
+        return Expression("%s.%s" % (operand(self.visit(attr.value), unary_precedence), attr.attr), postfix_precedence)
+
+    def visit_Import(self, imp: ast.Import):
+        for alias in imp.names:
+            assert alias.name == "sys" and alias.asname is None, f"Module {alias.name} is not supported yet"
 
     def visit_List(self, l: ast.List):
-        return "list::init(%s)" % (', '.join(self.visit(element) for element in l.elts),)
+        elements = ', '.join(self.visit(element) for element in l.elts)
+        t = self.type_of(l)
+        if element_type(t) in typed_list_elements:
+            # Initializer list holds Int, so integers that may not fit are appended
+            if t == list_of("int") and not all(isinstance(e, ast.Constant) and -2**63 < e.value < 2**63 for e in l.elts):
+                return "%s::init(std::pmr::get_default_resource(), %s)" % (cpp_type(t), elements)
+            return "%s{%s}" % (cpp_type(t), elements)
+        return "list::init(%s)" % (elements,)
+
+    def visit_Dict(self, d: ast.Dict):
+        assert None not in d.keys, "Unpacking in dict literals is not supported yet"
+        items = ', '.join("%s, %s" % (self.visit(key), self.visit(value)) for key, value in zip(d.keys, d.values))
+        return "python::Dict::init(%s)" % (items,)
+
+    def visit_Set(self, s: ast.Set):
+        return "python::Set::init(%s)" % (', '.join(self.visit(element) for element in s.elts),)
+
+    def visit_ListComp(self, comprehension: ast.ListComp):
+        return Expression("python::collect<%s>(%s)" % (cpp_type(self.type_of(comprehension)), self.generator(comprehension)), postfix_precedence)
+
+    def visit_SetComp(self, comprehension: ast.SetComp):
+        return Expression("set(%s)" % (self.generator(comprehension),), postfix_precedence)
+
+    def visit_DictComp(self, comprehension: ast.DictComp):
+        assert False, "Dict comprehensions are not supported yet"
+
+    def visit_GeneratorExp(self, expr: ast.GeneratorExp):
+        assert False, "Generator expressions are only supported as arguments of sum(), min(), max(), any() and all(), and as iterables of loops and comprehensions yet"
 
     def visit_Constant(self, const: ast.Constant) -> str:
         val = const.value
-        if val is None:           return "::python::None"
-        if isinstance(val, bool): return "true" if val else "false"
-        if isinstance(val, str):  return cpp_str(const.value)
+        if val is None:           return Expression("::python::None", postfix_precedence)
+        if isinstance(val, bool): return Expression("true" if val else "false", postfix_precedence)
+        if isinstance(val, str):  return Expression(self.codegen.string_constant(const.value), postfix_precedence)
         if isinstance(val, int):  return cpp_int(val)
         assert False, "constant not implemented yet: " + type(val)
 
-def compile_program(source: str, filename: str):
-    tree = ast.parse(source, filename, type_comments=True)
-    Visitor().visit(tree)
+@dataclass
+class Compilation:
+    "Program passed through compilation passes, from Python source to generated code"
+    source : str
+    tree : ast.Module
+    inference : Type_Inference = field(default_factory=Type_Inference)
+    codegen : Code_Generator = field(default_factory=Code_Generator)
+
+def lower(compilation: Compilation):
+    Visitor(compilation.inference, compilation.codegen).visit(compilation.tree)
+
+def remove_unreachable_code(compilation: Compilation):
+    "Drops statements following return, break or continue in the same block"
+    for body in compilation.codegen.bodies.values():
+        for block in walk_blocks(body):
+            for i, node in enumerate(block):
+                if isinstance(node, Statement) and (node.code in ("break", "continue", "return") or node.code.startswith("return ")):
+                    del block[i+1:]
+                    break
+
+def is_pure(expr: ast.expr, type_of) -> bool:
+    "Expression which evaluation can't raise or have side effects, other than moves"
+    for node in ast.walk(expr):
+        if isinstance(node, ast.Compare):
+            # Ordering of values of different types raises TypeError
+            for lhs, op, rhs in zip([node.left, *node.comparators], node.ops, node.comparators):
+                if not isinstance(op, (ast.Eq, ast.NotEq)) and (type_of(lhs) == "str") != (type_of(rhs) == "str"):
+                    return False
+        elif isinstance(node, ast.expr):
+            if not isinstance(node, (ast.Constant, ast.Name, ast.BinOp, ast.UnaryOp, ast.BoolOp, ast.IfExp)):
+                return False
+            if type_of(node) not in ("int", "bool", "str"):
+                return False
+        elif not isinstance(node, (ast.operator, ast.unaryop, ast.boolop, ast.cmpop, ast.expr_context)):
+            return False
+    return True
+
+def eliminate_dead_stores(compilation: Compilation):
+    "Drops assignments of pure values to local variables that are never read"
+    codegen, inference = compilation.codegen, compilation.inference
+    for name, body in codegen.bodies.items():
+        types = codegen.types[name]
+        read = { n.id for stmt in codegen.sources[name] for n in ast.walk(stmt) if isinstance(n, ast.Name) and not isinstance(n.ctx, ast.Store) }
+
+        def dead(statement: Statement) -> bool:
+            source = statement.source
+            if isinstance(source, ast.Assign) and len(source.targets) == 1:
+                target = source.targets[0]
+            elif isinstance(source, (ast.AnnAssign, ast.AugAssign)) and source.value is not None:
+                target = source.target
+            else:
+                return False
+            if not isinstance(target, ast.Name) or target.id in read or target.id not in types.locals or target.id in types.loop_variables:
+                return False
+            inference.current = types
+            # Augmented assignment computes with the current value of variable
+            return is_pure(source.value, inference.expr) and (not isinstance(source, ast.AugAssign) or is_pure(target, inference.expr))
+
+        for block in walk_blocks(body):
+            block[:] = [node for node in block if not (isinstance(node, Statement) and dead(node))]
+
+def remove_unused_locals(compilation: Compilation):
+    "Drops declarations of local variables which no statement refers to"
+    codegen = compilation.codegen
+    for name, body in codegen.bodies.items():
+        code = render(body)
+        codegen.locals[name] = { var: t for var, t in codegen.locals.get(name, {}).items() if re.search(r"\b%s\b" % (re.escape(var),), code) }
 
-def compiler_main(args: argparse.Namespace):
-    source_file = args.source[0]
+@dataclass
+class Pass:
+    name : str
+    run : Callable[[Compilation], None]
+    description : str
+
+    # Later passes depend on results of required ones, so they can't be disabled
+    required : bool = False
+
+# Passes of compilation in order of running: ones over Python AST, lowering
+# into generated code and ones over generated code
+passes = [
+    Pass("iterator-builtins", lambda c: ast.fix_missing_locations(Iterator_Builtins({ stmt.name for stmt in c.tree.body if isinstance(stmt, ast.FunctionDef) }).visit(c.tree)),
+        "rewrite map(), filter() and list() or set() of generator expressions into comprehensions", required=True),
+    Pass("infer-types", lambda c: c.inference.infer(c.tree), "infer types of variables, arguments and return values", required=True),
+    Pass("fold-constants", lambda c: Constant_Folding(c.inference.definitions).visit(c.tree), "evaluate constant expressions and calls of pure functions with constant arguments"),
+    Pass("parallel-loops", lambda c: mark_parallel_loops(c.tree, c.source), "run loops marked by `# compy: parallel` on multiple threads"),
+    Pass("lower", lower, "compile Python statements into C++", required=True),
+    Pass("unreachable-code", remove_unreachable_code, "remove statements following return, break and continue"),
+    Pass("dead-stores", eliminate_dead_stores, "remove assignments of pure values to variables that are never read"),
+    Pass("unused-locals", remove_unused_locals, "remove declarations of unused local variables"),
+]
+
+# Names of passes skipped by --disable-pass
+disabled_passes : set[str] = set()
+
+def compile_program(source: str, filename: str) -> Code_Generator:
+    compilation = Compilation(source, ast.parse(source, filename, type_comments=True))
+    for p in passes:
+        if p.name not in disabled_passes:
+            p.run(compilation)
+    return compilation.codegen
+
+def compile_file(source_file: str, profile: Build_Profile) -> str:
+    "Compiles Python source file into executable, returns its path"
     try:
         with open(source_file) as f:
             source_code = f.read()
     except FileNotFoundError as e:
-        print("compy: error: Source file '%s' has not been found" % (e.filename,), file=sys.stderr)
-        os._exit(1)
+        raise Compilation_Error("Source file '%s' has not been found" % (e.filename,))
+
+    executable = os.path.join(".", f"{source_file}.out")
+    cached = os.path.join(cache_directory(), "programs", program_hash(source_code, profile))
+
+    if cache_mode and os.path.exists(cached):
+        if not silent_mode:
+            print("[CACHE] %s" % (cached,), file=messages, flush=True)
+        copy_atomically(cached, executable)
+        return executable
+
+    codegen = compile_program(source_code, source_file)
+    if incremental_mode:
+        build_incremental(codegen, source_file, executable, profile)
+    else:
+        codegen.save(f"{source_file}.cc")
+        build_program(source_file, executable, profile)
+
+    if cache_mode:
+        os.makedirs(os.path.dirname(cached), exist_ok=True)
+        copy_atomically(executable, cached)
+    return executable
+
+def program_hash(source_code: str, profile: Build_Profile) -> str:
+    "Identifies executable by everything that affects it's compilation"
+    h = hashlib.sha256()
+    with open(__file__, "rb") as f:
+        h.update(f.read())
+    h.update(runtime_hash(profile).encode())
+    h.update(repr((arena_mode, profile_mode, sorted(disabled_passes), profile)).encode())
+    if profile.pgo_training_input:
+        with open(profile.pgo_training_input, "rb") as f:
+            h.update(f.read())
+    h.update(source_code.encode())
+    return h.hexdigest()
+
+def copy_atomically(source: str, destination: str):
+    "Copies file, so that destination is never observed partially written"
+    # Name is unique also between threads compiling files in parallel
+    directory, name = os.path.split(destination)
+    with tempfile.NamedTemporaryFile(dir=directory or ".", prefix=f"{name}.", suffix=".tmp", delete=False) as f:
+        temporary = f.name
+    try:
+        shutil.copy2(source, temporary)
+        os.replace(temporary, destination)
+    except BaseException:
+        os.unlink(temporary)
+        raise
+
+def build_program(source_file: str, executable: str, profile: Build_Profile):
+    if profile.pgo_training_input is None:
+        build_executable(profile.command(f"{source_file}.cc", executable), executable)
+        return
+
+    # Profile guided optimization: build instrumented executable, train it
+    # and rebuild with collected profile. Both builds share output path,
+    # since GCC names profile data after it.
+    profile_dir = os.path.abspath(f"{source_file}.profile")
+    shutil.rmtree(profile_dir, ignore_errors=True)
+    os.makedirs(profile_dir)
+
+    build_executable(profile.command(f"{source_file}.cc", executable, profile.pgo_generate_flags(profile_dir)), executable)
+
+    training_input = open(profile.pgo_training_input) if profile.pgo_training_input else subprocess.DEVNULL
+    try:
+        run_command([executable], stdin=training_input, stdout=subprocess.DEVNULL)
+    finally:
+        if training_input is not subprocess.DEVNULL:
+            training_input.close()
+
+    if profile.is_clang():
+        raw_profiles = [os.path.join(profile_dir, f) for f in os.listdir(profile_dir) if f.endswith(".profraw")]
+        merge = run_command(["llvm-profdata", "merge", f"-output={profile_dir}/merged.profdata", *raw_profiles])
+        if merge.returncode != 0:
+            raise Compilation_Error("Merging of profile data failed")
+
+    build_executable(profile.command(f"{source_file}.cc", executable, profile.pgo_use_flags(profile_dir)), executable)
+    shutil.rmtree(profile_dir, ignore_errors=True)
+
+def build_incremental(codegen: Code_Generator, source_file: str, executable: str, profile: Build_Profile):
+    "Builds translation units of changed functions in parallel and links them"
+    directory = f"{source_file}.build"
+    os.makedirs(directory, exist_ok=True)
+    units = codegen.save_incremental(directory)
+
+    with open(os.path.join(directory, "program.hh")) as f:
+        header = f.read()
+
+    # Object is up to date when it's stamp matches hash of everything it was compiled from
+    outdated = []
+    for unit in units:
+        with open(unit) as f:
+            unit_hash = hashlib.sha256((header + f.read() + repr(profile.compile_command(unit, ""))).encode()).hexdigest()
+        obj = unit.removesuffix(".cc") + ".o"
+        try:
+            with open(obj + ".hash") as f:
+                if f.read() == unit_hash and os.path.exists(obj):
+                    continue
+        except FileNotFoundError:
+            pass
+        outdated.append((unit, obj, unit_hash))
+
+    # Remove leftovers of functions which are no longer part of program
+    current = { os.path.basename(unit).removesuffix(".cc") for unit in units }
+    for f in os.listdir(directory):
+        if f != "program.hh" and f.split(".")[0] not in current:
+            os.unlink(os.path.join(directory, f))
+
+    def compile_unit(job: tuple[str, str, str]) -> bool:
+        unit, obj, unit_hash = job
+        if run_compiler(profile.compile_command(unit, obj)).returncode != 0:
+            return False
+        with open(obj + ".hash", "w") as f:
+            f.write(unit_hash)
+        return True
+
+    with concurrent.futures.ThreadPoolExecutor(max_workers=os.cpu_count()) as pool:
+        compiled = list(pool.map(compile_unit, outdated))
+
+    if not all(compiled):
+        raise Compilation_Error("Compilation of C++ code failed")
+
+    objects = [unit.removesuffix(".cc") + ".o" for unit in units]
+    build_executable(profile.link_command(objects, executable), executable)
+
+def build_executable(cmd: list[str], executable: str):
+    compilation_result = run_compiler(cmd)
 
-    compile_program(source_code, source_file)
+    if compilation_result.returncode != 0:
+        if os.path.exists(executable):
+            os.unlink(executable)
+        raise Compilation_Error("Compilation of C++ code failed")
+
+def sample_peak_rss(pid: int, done: threading.Event, peak: list[int]):
+    "Samples high water mark of resident set size of running process until done"
+    while True:
+        try:
+            with open(f"/proc/{pid}/status") as f:
+                for line in f:
+                    if line.startswith("VmHWM:"):
+                        peak[0] = max(peak[0], int(line.split()[1]))
+        except (FileNotFoundError, ProcessLookupError):
+            break
+        if done.wait(0.001):
+            break
+
+def measure(cmd: list[str], runs: int) -> dict:
+    "Wall time in seconds and peak resident set size in KiB of running cmd several times"
+    times, peak_rss = [], 0
+    for _ in range(runs):
+        start = time.perf_counter()
+        process = subprocess.Popen(cmd, stdout=subprocess.DEVNULL)
+
+        # Child inherits ru_maxrss of compy process at exec on Linux, so peak
+        # memory usage is sampled from /proc while it runs instead.
+        done, sampled = threading.Event(), [0]
+        sampler = threading.Thread(target=sample_peak_rss, args=(process.pid, done, sampled))
+        if os.path.exists("/proc/self/status"):
+            sampler.start()
+
+        _, status, usage = os.wait4(process.pid, 0)
+        times.append(time.perf_counter() - start)
+        done.set()
+        if sampler.is_alive():
+            sampler.join()
+
+        process.returncode = os.waitstatus_to_exitcode(status)
+        if process.returncode != 0:
+            print("compy: error: '%s' exited with code %d" % (" ".join(cmd), process.returncode), file=sys.stderr)
+            os._exit(1)
+
+        if sampler.ident is not None:
+            rss = sampled[0]
+        elif sys.platform == "darwin":
+            rss = usage.ru_maxrss // 1024
+        else:
+            rss = usage.ru_maxrss
+        peak_rss = max(peak_rss, rss)
+
+    # Programs may finish before first sample is taken
+    return { "min": min(times), "median": statistics.median(times), "peak_rss_kib": peak_rss or None }
+
+def bench_main(args: argparse.Namespace, source_file: str, executable: str, profile: Build_Profile) -> dict:
+    compiled = measure([executable], args.bench)
+    interpreted = measure([sys.executable, source_file], args.bench)
+    report = {
+        "source": source_file,
+        "runs": args.bench,
+        "build": [profile.cxx, *profile.flags()],
+        "pgo": profile.pgo_training_input is not None,
+        "disabled_passes": sorted(disabled_passes),
+        "compiled": compiled,
+        "python": interpreted,
+        "speedup": interpreted["median"] / compiled["median"],
+    }
+
+    print("=== %s" % (source_file,), file=messages)
+    for name, result in (("compiled", compiled), ("python", interpreted)):
+        rss = "%8d KiB" % (result["peak_rss_kib"],) if result["peak_rss_kib"] else "unknown"
+        print("%-10s min %8.4fs  median %8.4fs  peak rss %s" % (name, result["min"], result["median"], rss), file=messages)
+    print("speedup    %.2fx" % (report["speedup"],), file=messages)
+
+    if profile.track_allocations:
+        report["allocations"] = measure_allocations(executable)
+        total = report["allocations"]["total"]
+        print("allocations %d, %d bytes, peak live %d bytes" % (total["allocations"], total["bytes"], total["peak_live_bytes"]), file=messages)
+    return report
+
+def measure_allocations(executable: str) -> dict:
+    "Allocation counters of a single run of executable built with allocation tracking"
+    with tempfile.TemporaryDirectory() as directory:
+        path = os.path.join(directory, "allocations.json")
+        env = { **os.environ, "COMPY_ALLOCATIONS_JSON": path }
+        subprocess.run([executable], stdout=subprocess.DEVNULL, env=env, check=True)
+        with open(path) as f:
+            return json.load(f)
+
+def source_files(paths: list[str]) -> list[str]:
+    "Expands directories into Python files they contain"
+    files = []
+    for path in paths:
+        if os.path.isdir(path):
+            for root, dirs, names in os.walk(path):
+                dirs.sort()
+                files += [os.path.join(root, name) for name in sorted(names) if name.endswith(".py")]
+        else:
+            files.append(path)
+    return files
+
+def compile_files(sources: list[str], profile: Build_Profile, jobs: int) -> dict[str, str]:
+    """
+    Compiles source files in parallel, returns executables by their source.
+    Failures are reported after all compilations finish.
+    """
+    executables, failed = {}, False
+    with concurrent.futures.ThreadPoolExecutor(max_workers=jobs) as pool:
+        futures = { pool.submit(compile_file, source, profile): source for source in sources }
+        for future in concurrent.futures.as_completed(futures):
+            try:
+                executables[futures[future]] = future.result()
+            except Compilation_Error as e:
+                print("compy: error: %s: %s" % (futures[future], e), file=sys.stderr)
+                failed = True
+            except Exception as e:
+                print("compy: error: %s: %s: %s" % (futures[future], type(e).__name__, e), file=sys.stderr)
+                failed = True
+    if failed:
+        sys.exit(1)
+    return executables
 
-    codegen.save(f"{source_file}.cc")
-    compilation_result = run_command(["g++",
-        "-std=c++20",
-        "-Wall", "-Wextra", "-Wno-unused-variable",
-        f"{source_file}.cc", "-o", f"{source_file}.out",
-        f"-I{compy_location}"])
+def compiler_main(args: argparse.Namespace):
+    profile = Build_Profile(
+        cxx=args.cxx,
+        opt_level=args.opt_level,
+        march=args.march,
+        lto=args.lto,
+        pgo_training_input=(args.pgo_input or "") if args.pgo else None,
+        track_allocations=args.track_allocations,
+        profile=args.profile)
+
+    sources = source_files(args.source)
+    executables = compile_files(sources, profile, args.jobs)
+    if args.no_run:
+        return
+
+    if args.bench:
+        reports = [bench_main(args, source, executables[source], profile) for source in sources]
+        report = reports[0] if len(reports) == 1 else reports
+        if args.bench_json == "-":
+            json.dump(report, sys.stdout, indent=2)
+            print()
+        elif args.bench_json:
+            with open(args.bench_json, "w") as f:
+                json.dump(report, f, indent=2)
+        return
 
-    if compilation_result.returncode != 0:
-        sys.stdout.flush()
-        print("[ERROR] Compilation of C++ code failed", file=sys.stderr)
-        if os.path.exists(f"./{source_file}.out"):
-            os.unlink(f"./{source_file}.out")
-        os._exit(1)
+    for source in sources:
+        run_main(args, source, executables[source])
 
-    compiler_result = run_command([f"./{source_file}.out"], capture_output=args.test)
+def run_main(args: argparse.Namespace, source_file: str, executable: str):
+    compiler_result = run_command([executable], capture_output=args.test)
 
     if args.test:
         interpreter_result = run_command(["python", f"./{source_file}"], capture_output=True)
@@ -287,15 +2369,50 @@ def compiler_main(args: argparse.Namespace):
         print("=== SUCCESS ===================================")
 
 def main():
-    global silent_mode
+    global silent_mode, messages, arena_mode, cache_mode, incremental_mode, profile_mode, disabled_passes, compiler_slots
 
     p = argparse.ArgumentParser(prog='compy', description="Python to C++ compiler")
-    p.add_argument("source", nargs=1, type=str, help="Python file to compile")
+    p.add_argument("source", nargs="+", type=str, help="Python files or directories with them to compile")
+    p.add_argument("-j", "--jobs", type=int, default=os.cpu_count() or 1, metavar="N", help="Number of compiler processes running in parallel (default: number of cores)")
+    p.add_argument("--no-run", action="store_true", help="Only compile programs, don't run them")
     p.add_argument("--test", action="store_true")
     p.add_argument("--silent", action="store_true")
+    p.add_argument("--arena", action="store_true", help="Allocate temporary lists from per block arena")
+    p.add_argument("--incremental", action="store_true", help="Compile each function as separate translation unit, rebuilding only changed ones")
+    p.add_argument("--profile", action="store_true", help="Instrument functions and loops, report their timings and allocations at exit")
+    p.add_argument("--track-allocations", action="store_true", help="Count allocations, bytes and peak live bytes by runtime type, report them at exit")
+    p.add_argument("--no-cache", action="store_true", help="Always compile program, even if it's executable is cached")
+    p.add_argument("--bench", nargs="?", const=5, type=int, metavar="N", help="Compare running time of compiled program and Python interpreter over N runs (default: 5)")
+    p.add_argument("--bench-json", metavar="FILE", help="Write benchmark results as JSON into FILE, '-' for standard output")
+    p.add_argument("--cxx", default="g++", help="C++ compiler used to build generated code, g++ or clang++ (default: g++)")
+    p.add_argument("--opt-level", default="2", choices=["0", "1", "2", "3", "s", "fast"], help="Optimization level of generated code (default: 2)")
+    p.add_argument("--march", metavar="ARCH", help="Target architecture of generated code, like 'native'")
+    p.add_argument("--lto", action="store_true", help="Enable link time optimization")
+    p.add_argument("--pgo", action="store_true", help="Profile guided optimization: build instrumented executable, run it and rebuild with collected profile")
+    p.add_argument("--pgo-input", metavar="FILE", help="Standard input of PGO training run (default: empty)")
+    p.add_argument("--disable-pass", action="append", default=[], metavar="PASS", choices=[p.name for p in passes if not p.required],
+        help="Skip compilation pass, to measure its effect with --bench: " + "; ".join(f"{p.name} - {p.description}" for p in passes if not p.required))
 
     args = p.parse_args()
+    if args.bench_json and not args.bench:
+        p.error("--bench-json requires --bench")
+    if args.pgo and args.incremental:
+        p.error("--pgo is not supported with --incremental")
+    if args.pgo_input and not args.pgo:
+        p.error("--pgo-input requires --pgo")
+    if args.bench is not None and args.bench < 1:
+        p.error("--bench requires at least one run")
+    if args.jobs < 1:
+        p.error("--jobs requires at least one worker")
     silent_mode = args.test or args.silent
+    if args.bench_json == "-":
+        messages = sys.stderr
+    arena_mode = args.arena
+    cache_mode = not args.no_cache
+    incremental_mode = args.incremental
+    profile_mode = args.profile
+    disabled_passes = set(args.disable_pass)
+    compiler_slots = threading.BoundedSemaphore(args.jobs)
 
     compiler_main(args)
 
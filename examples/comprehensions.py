@@ -0,0 +1,39 @@
+def square(x: int) -> int:
+    return x * x
+
+def positive(x: int) -> bool:
+    return x > 0
+
+n = 1000
+print(sum(x * x for x in range(n) if x > 10))
+print(sum(x * x for x in range(n) if x % 3))
+print(sum(x for x in range(n) if x > 5 if x < 20))
+xs = [3, -1, 4, -1, 5, -9, 2, 6]
+print([x * 2 for x in xs])
+print([x for x in xs if x > 0])
+print(list(map(square, xs)))
+print(list(filter(positive, xs)))
+print(list(map(lambda x: x + 1, filter(lambda x: x > 1, xs))))
+print(sum(map(square, xs)), min(x * 3 for x in xs), max(abs_x for abs_x in map(square, xs)))
+print(any(x > 5 for x in xs), all(x > 5 for x in xs), any(xs), all([]))
+words = ["apple", "", "banana", "cherry", ""]
+print([w + "!" for w in words if w != ""])
+print(list(filter(None, words)))
+print(len([c for c in "hello world" if c != "o"]))
+s = {w for w in words}
+print(len(s))
+print(set(x for x in xs if x < 0))
+nested = [[1, 2], [3], []]
+print([len(l) for l in nested])
+for y in (x * x for x in range(5)):
+    print(y)
+print(sum(x * x for x in [y + 1 for y in range(10)]), sum([x for x in range(10)]))
+x = "outer"
+print([x for x in range(3)], x)
+total = 0
+for k in range(3):
+    total = total + sum(k * j for j in range(10))
+print(total)
+print(min(range(3, 10)), max(w for w in words), sum(x > 0 for x in xs))
+mixed = [1, "a", 2]
+print([m for m in mixed if m != "a"])
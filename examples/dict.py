@@ -0,0 +1,57 @@
+def rehash():
+    squares = {}
+    for i in range(1000):
+        squares[i] = i * i
+    print(len(squares), squares[0], squares[999], 500 in squares, 1000 in squares)
+
+    total = 0
+    for k in squares:
+        total += k
+    print(total)
+
+    for i in range(0, 1000, 2):
+        del squares[i]
+    for i in range(1000, 1200):
+        squares[i] = i
+    print(len(squares), 2 in squares, 3 in squares, squares[1199])
+
+def overwrite():
+    d = {}
+    for i in range(100):
+        d[i % 10] = i
+    print(d)
+    d[3] += 1000
+    print(len(d), d[3])
+
+def mixed_keys():
+    d = {1: "one", "1": 1, 2: "two"}
+    d["two"] = 2
+    print(d, 1 in d, "1" in d, 3 in d, "3" in d)
+    del d[1]
+    d[1] = "again"
+    print(d)
+
+def order():
+    d = {}
+    for w in ["pear", "fig", "apple", "kiwi"]:
+        d[w] = len(w)
+    del d["fig"]
+    d["fig"] = 0
+    d["pear"] = 5
+    for k, v in d.items():
+        print(k, v)
+    for k in d.keys():
+        print(k)
+    for v in d.values():
+        print(v)
+
+def printing():
+    print({}, set(), {1: {}}, {1: set()})
+    print({"a": {"b": {"c": [1, 2]}}, "d": {3}})
+    print({1, 2, 3}, {0: {7}, 1: [set()]})
+
+rehash()
+overwrite()
+mixed_keys()
+order()
+printing()
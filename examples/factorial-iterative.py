@@ -8,7 +8,7 @@ def factorial_while(n) -> int:
 
 def factorial_for(n) -> int:
     result : int = 1
-    for i in range(1, n+1):
+    for i in range(1, n+1): # compy: parallel
         result *= i
     return result
 
@@ -0,0 +1,18 @@
+def mods():
+    for a in [7, -7, 0, 9223372036854775807, -9223372036854775808]:
+        for b in [3, -3, 1, -1, 9223372036854775807]:
+            print(a % b, end=" ")
+        print()
+    big = 1267650600228229401496703205376
+    print(big % 7, -big % 7, big % -7, big % 4294967311, big % (big - 1), (-big) % (big + 12345678901234567890), big % big)
+    x : any = 17
+    x %= 5
+    print(x, x % -4)
+    y = -17
+    y %= 5
+    print(y)
+    xs = [10, -10]
+    xs[1] %= 3
+    print(xs, 10 % 4, -10 % 4)
+
+mods()
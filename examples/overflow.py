@@ -0,0 +1,40 @@
+def sums():
+    big = [9223372036854775807, 1]
+    print(sum(big))
+    low = [-9223372036854775807, -1, -1]
+    print(sum(low))
+    lanes = [9223372036854775807] * 4 + [1] * 4 + [-9223372036854775807] * 4 + [5, 6]
+    print(sum(lanes))
+    wide = [4611686018427387904] * 9
+    print(sum(wide))
+    fits = [i for i in range(1000)]
+    print(sum(fits))
+    mixed : list = [9223372036854775807, 1]
+    print(sum(mixed))
+
+def items():
+    xs = [9223372036854775807, 5]
+    xs[1] = xs[0] + 1
+    print(xs, xs[1] - xs[0])
+    for x in xs:
+        print(x * x)
+    xs[0] += 1
+    print(xs == [9223372036854775808, 9223372036854775808], 9223372036854775808 in xs)
+    print(min(xs), max(xs + [-1]), sum(xs * 3), xs[1:])
+    print([x + 1 for x in xs])
+
+def literals():
+    print(9223372036854775807 + 1, -9223372036854775807 - 2, 4294967296 * 4294967296)
+    xs = [9223372036854775807 + 1, 0]
+    print(xs)
+
+def counted():
+    for i in range(4294967296, 4294967298):
+        print(i * i, i * 2147483648 * 2)
+    xs = [0] * 65536
+    print(len(xs) * len(xs) * 2)
+
+sums()
+items()
+literals()
+counted()
@@ -0,0 +1,21 @@
+def squares(n: int) -> list:
+    a = [0] * n
+    for i in range(n): # compy: parallel
+        a[i] = i * i
+    return a
+
+def prefix(n: int) -> int:
+    a = [0] * n
+    for i in range(1, n): # compy: parallel
+        a[i] = a[i - 1] + 1
+    return a[n - 1]
+
+def histogram(n: int) -> int:
+    h = [0]
+    for i in range(n): # compy: parallel
+        h[0] = h[0] + 1
+    return h[0]
+
+print(sum(squares(1000)))
+print(prefix(1000000))
+print(histogram(1000000))
@@ -0,0 +1,38 @@
+# Reads lines of examples/reader.txt, from file and from standard input.
+# Run from root of the repository with the file on standard input too:
+#   python compy.py examples/reader.py < examples/reader.txt
+
+def read_lines(path: str):
+    # Files opened in text mode end lines with \n, even ones ending with \r\n
+    for line in open(path):
+        print(len(line), line, end="")
+    print()
+
+def read_parts(path: str):
+    f = open(path)
+    first = f.readline()
+    print(len(first), first, end="")
+    rest = f.read()
+    print(len(rest), rest)
+    # At the end of file both return empty string
+    print(len(f.readline()), len(f.read()))
+    f.close()
+
+def read_input():
+    # input() strips only \n, standard input isn't translated
+    first = input()
+    print(len(first), first)
+    windows = input()
+    print(len(windows))
+    indented = input()
+    print(len(indented))
+    empty = input()
+    print(len(empty))
+    last = input()
+    print(len(last), last)
+    # End of input raises EOFError
+    input()
+
+read_lines("examples/reader.txt")
+read_parts("examples/reader.txt")
+read_input()
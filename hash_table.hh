@@ -0,0 +1,254 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <vector>
+
+// Hash table of dict and set. Entries are stored densely in insertion order,
+// like in CPython, and located through open addressing index in the style
+// of Swiss tables: control byte of each bucket holds 7 bits of hash, which
+// are matched 8 buckets at a time, so most probes touch single cache line
+// and compare only keys with matching hash bits.
+namespace python
+{
+	/// Buckets with positions of entries, allocated as single block
+	struct Hash_Index
+	{
+		static constexpr std::size_t group_width = 8;
+		static constexpr std::uint8_t empty = 0x80, erased_bucket = 0xfe;
+
+		/// Header of buckets count, insertions left before rebuild and erased buckets,
+		/// followed by positions of entries and control bytes. First group of control
+		/// bytes is cloned after the last one, so groups never wrap around.
+		std::unique_ptr<std::uint32_t[]> block;
+
+		static constexpr std::size_t header = 4;
+
+		Hash_Index() = default;
+
+		explicit Hash_Index(std::size_t buckets)
+			: block(new std::uint32_t[header + buckets + (buckets + group_width) / sizeof(std::uint32_t)])
+		{
+			block[0] = buckets;
+			block[1] = buckets - buckets / group_width;
+			block[2] = 0;
+			std::memset(control(), empty, buckets + group_width);
+		}
+
+		Hash_Index(Hash_Index const& other)
+		{
+			if (other.block) {
+				auto const words = header + other.buckets() + (other.buckets() + group_width) / sizeof(std::uint32_t);
+				block.reset(new std::uint32_t[words]);
+				std::memcpy(block.get(), other.block.get(), words * sizeof(std::uint32_t));
+			}
+		}
+
+		Hash_Index(Hash_Index&&) noexcept = default;
+		Hash_Index& operator=(Hash_Index&&) noexcept = default;
+
+		Hash_Index& operator=(Hash_Index const& other)
+		{
+			if (this != &other) *this = Hash_Index(other);
+			return *this;
+		}
+
+		std::size_t buckets() const { return block ? block[0] : 0; }
+		std::size_t growth_left() const { return block ? block[1] : 0; }
+		std::size_t erased() const { return block ? block[2] : 0; }
+
+		std::uint32_t slot(std::size_t bucket) const { return block[header + bucket]; }
+
+		/// Bucket holding entry for which eq(position) holds, -1 when there's none
+		template<typename Eq>
+		std::ptrdiff_t find(std::size_t hash, Eq &&eq) const
+		{
+			if (!block) return -1;
+			for (Probe probe(hash, buckets()); ; probe.next()) {
+				auto const group = load(probe.position);
+				for (auto matches = match(group, tag(hash)); matches; matches &= matches - 1) {
+					auto const bucket = probe.at(matches);
+					if (eq(slot(bucket))) return bucket;
+				}
+				if (match(group, empty)) return -1;
+			}
+		}
+
+		/// Requires growth_left() > 0 and entry with equal key not being indexed
+		void insert(std::size_t hash, std::uint32_t position)
+		{
+			for (Probe probe(hash, buckets()); ; probe.next()) {
+				// Empty and erased buckets have the highest bit set
+				if (auto const free = load(probe.position) & 0x8080808080808080) {
+					auto const bucket = probe.at(free);
+					if (control()[bucket] == empty) --block[1];
+					set_control(bucket, tag(hash));
+					block[header + bucket] = position;
+					return;
+				}
+			}
+		}
+
+		void erase(std::size_t bucket)
+		{
+			set_control(bucket, erased_bucket);
+			++block[2];
+		}
+
+	private:
+		struct Probe
+		{
+			std::size_t position, mask, step = 0;
+
+			Probe(std::size_t hash, std::size_t buckets)
+				: position((hash >> 7) & (buckets - 1)), mask(buckets - 1)
+			{
+			}
+
+			/// Triangular probing visits every group when buckets are power of 2
+			void next()
+			{
+				step += group_width;
+				position = (position + step) & mask;
+			}
+
+			/// Bucket of the lowest matching byte
+			std::size_t at(std::uint64_t matches) const
+			{
+				return (position + std::countr_zero(matches) / 8) & mask;
+			}
+		};
+
+		static std::uint8_t tag(std::size_t hash) { return hash & 0x7f; }
+
+		std::uint8_t* control() const
+		{
+			return reinterpret_cast<std::uint8_t*>(block.get() + header + buckets());
+		}
+
+		void set_control(std::size_t bucket, std::uint8_t value)
+		{
+			control()[bucket] = value;
+			if (bucket < group_width) control()[buckets() + bucket] = value;
+		}
+
+		/// Control bytes of group, in order of buckets from the lowest byte
+		std::uint64_t load(std::size_t position) const
+		{
+			std::uint64_t group;
+			std::memcpy(&group, control() + position, sizeof(group));
+			if constexpr (std::endian::native == std::endian::big) group = __builtin_bswap64(group);
+			return group;
+		}
+
+		/// Highest bit set in each byte of group equal to value
+		static std::uint64_t match(std::uint64_t group, std::uint8_t value)
+		{
+			constexpr std::uint64_t low = 0x7f7f7f7f7f7f7f7f;
+			auto const x = group ^ (0x0101010101010101 * value);
+			return ~(((x & low) + low) | x | low);
+		}
+	};
+
+	/// Entries in insertion order with index over them. Entry has hash, key
+	/// and removed members; removed entries are skipped until next rebuild.
+	/// Keys are compared by predicate, so they can be looked up by values
+	/// of other types, like str by its view.
+	template<typename Entry>
+	struct Hash_Table
+	{
+		std::vector<Entry> entries;
+		Hash_Index index;
+
+		std::size_t size() const { return entries.size() - index.erased(); }
+
+		/// Entry with given hash, which key satisfies equal(key)
+		template<typename Equal>
+		Entry* find(std::size_t hash, Equal &&equal)
+		{
+			auto const bucket = index.find(hash, [&](std::uint32_t i) { return entries[i].hash == hash && equal(entries[i].key); });
+			return bucket < 0 ? nullptr : &entries[index.slot(bucket)];
+		}
+
+		template<typename Equal>
+		Entry const* find(std::size_t hash, Equal &&equal) const
+		{
+			return const_cast<Hash_Table*>(this)->find(hash, equal);
+		}
+
+		/// Appends entry, which key must not be present yet
+		Entry& insert(Entry &&entry)
+		{
+			// Removed entries are dropped once they outnumber the rest
+			if (index.growth_left() == 0 || 2 * index.erased() > entries.size()) rebuild();
+			index.insert(entry.hash, entries.size());
+			return entries.emplace_back(std::move(entry));
+		}
+
+		/// Removes entry found like by find(), false when there's none
+		template<typename Equal>
+		bool erase(std::size_t hash, Equal &&equal)
+		{
+			auto const bucket = index.find(hash, [&](std::uint32_t i) { return entries[i].hash == hash && equal(entries[i].key); });
+			if (bucket < 0) return false;
+			auto &entry = entries[index.slot(bucket)];
+			entry = Entry{};
+			entry.removed = true;
+			index.erase(bucket);
+			return true;
+		}
+
+		void clear()
+		{
+			entries.clear();
+			index = Hash_Index();
+		}
+
+	private:
+		/// Drops removed entries and sizes index for twice as many of the rest
+		void rebuild()
+		{
+			std::erase_if(entries, [](Entry const& entry) { return entry.removed; });
+			std::size_t buckets = Hash_Index::group_width;
+			while (buckets - buckets / Hash_Index::group_width < 2 * (entries.size() + 1)) buckets *= 2;
+			index = Hash_Index(buckets);
+			for (std::uint32_t i = 0; i < entries.size(); ++i) {
+				index.insert(entries[i].hash, i);
+			}
+		}
+	};
+
+	/// Iterator over entries that weren't removed, yielding projection of them
+	template<typename Entry, typename Projection>
+	struct Live_Entries
+	{
+		Entry const *first, *last;
+
+		struct Iterator
+		{
+			Entry const *p, *last;
+
+			decltype(auto) operator*() const { return Projection{}(*p); }
+
+			Iterator& operator++()
+			{
+				do ++p; while (p != last && p->removed);
+				return *this;
+			}
+
+			bool operator==(Iterator const& other) const { return p == other.p; }
+		};
+
+		Iterator begin() const
+		{
+			auto p = first;
+			while (p != last && p->removed) ++p;
+			return { p, last };
+		}
+
+		Iterator end() const { return { last, last }; }
+	};
+}
@@ -0,0 +1,225 @@
+#pragma once
+
+#include <compare>
+#include <concepts>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Python's int. Values are kept in native 64 bit integer and arithmetic is
+// checked for overflow, only results that don't fit are promoted to BigInt.
+// Slow paths live in runtime.cc.
+namespace python
+{
+	using Int = std::int64_t;
+
+	/// Arbitrary precision integer in sign and magnitude representation
+	struct BigInt
+	{
+		bool negative = false;
+
+		/// Magnitude in base 2^32, least significant first, without leading zeros
+		std::vector<std::uint32_t> limbs;
+
+		BigInt() = default;
+		explicit BigInt(Int value);
+
+		/// Parses decimal digits with optional leading minus
+		explicit BigInt(std::string_view digits);
+
+		bool is_zero() const { return limbs.empty(); }
+		bool fits_int() const;
+
+		/// Value as native integer, requires fits_int()
+		Int to_int() const;
+
+		std::string to_string() const;
+
+		BigInt operator-() const;
+		bool operator==(BigInt const&) const = default;
+	};
+
+	BigInt operator+(BigInt const& lhs, BigInt const& rhs);
+	BigInt operator-(BigInt const& lhs, BigInt const& rhs);
+	BigInt operator*(BigInt const& lhs, BigInt const& rhs);
+
+	/// Remainder with sign of divisor, like in Python, divisor must be nonzero
+	BigInt operator%(BigInt const& lhs, BigInt const& rhs);
+	std::strong_ordering operator<=>(BigInt const& lhs, BigInt const& rhs);
+
+	[[noreturn]] void throw_overflow_error();
+
+	struct Integer
+	{
+		Int small = 0;
+
+		/// Set only when value doesn't fit into small
+		std::shared_ptr<BigInt const> big{};
+
+		Integer() = default;
+		Integer(std::integral auto value) : small(value) {}
+
+		/// Keeps value in small when it fits
+		Integer(BigInt value);
+
+		bool is_small() const { return big == nullptr; }
+
+		BigInt to_big() const { return big ? *big : BigInt(small); }
+
+		/// Conversion where native integer is required like indices or
+		/// range bounds, raises OverflowError when value doesn't fit
+		operator Int() const
+		{
+			if (big) [[unlikely]] throw_overflow_error();
+			return small;
+		}
+
+		explicit operator bool() const { return big || small != 0; }
+	};
+
+	Integer add_slow(Integer const& lhs, Integer const& rhs);
+	Integer sub_slow(Integer const& lhs, Integer const& rhs);
+	Integer mul_slow(Integer const& lhs, Integer const& rhs);
+	Integer mod_slow(Integer const& lhs, Integer const& rhs);
+	Integer neg_slow(Integer const& value);
+	std::strong_ordering compare_slow(Integer const& lhs, Integer const& rhs);
+
+	namespace integer
+	{
+		inline bool is_small(Integer const& i) { return i.is_small(); }
+		inline bool is_small(std::integral auto) { return true; }
+
+		inline Int small(Integer const& i) { return i.small; }
+		inline Int small(std::integral auto i) { return i; }
+	}
+
+	template<typename T>
+	concept Integer_Operand = std::same_as<std::remove_cvref_t<T>, Integer> || std::integral<std::remove_cvref_t<T>>;
+
+	/// At least one operand is Integer, so built-in operators stay untouched.
+	/// Templates match exactly, which prevents ambiguity with built-in
+	/// operators reachable through conversion of Integer to Int.
+	template<typename L, typename R>
+	concept Integer_Operands = Integer_Operand<L> && Integer_Operand<R>
+		&& (std::same_as<std::remove_cvref_t<L>, Integer> || std::same_as<std::remove_cvref_t<R>, Integer>);
+
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	Integer operator+(L const& lhs, R const& rhs)
+	{
+		Int result;
+		if (integer::is_small(lhs) && integer::is_small(rhs)
+				&& !__builtin_add_overflow(integer::small(lhs), integer::small(rhs), &result)) [[likely]] {
+			return result;
+		}
+		return add_slow(Integer(lhs), Integer(rhs));
+	}
+
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	Integer operator-(L const& lhs, R const& rhs)
+	{
+		Int result;
+		if (integer::is_small(lhs) && integer::is_small(rhs)
+				&& !__builtin_sub_overflow(integer::small(lhs), integer::small(rhs), &result)) [[likely]] {
+			return result;
+		}
+		return sub_slow(Integer(lhs), Integer(rhs));
+	}
+
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	Integer operator*(L const& lhs, R const& rhs)
+	{
+		Int result;
+		if (integer::is_small(lhs) && integer::is_small(rhs)
+				&& !__builtin_mul_overflow(integer::small(lhs), integer::small(rhs), &result)) [[likely]] {
+			return result;
+		}
+		return mul_slow(Integer(lhs), Integer(rhs));
+	}
+
+	/// Remainder with sign of divisor, like in Python
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	Integer operator%(L const& lhs, R const& rhs)
+	{
+		if (integer::is_small(lhs) && integer::is_small(rhs) && integer::small(rhs) > 0) [[likely]] {
+			Int const result = integer::small(lhs) % integer::small(rhs);
+			return result < 0 ? result + integer::small(rhs) : result;
+		}
+		return mod_slow(Integer(lhs), Integer(rhs));
+	}
+
+	inline Integer operator-(Integer const& value)
+	{
+		Int result;
+		if (value.is_small() && !__builtin_sub_overflow(Int(0), value.small, &result)) [[likely]] {
+			return result;
+		}
+		return neg_slow(value);
+	}
+
+	template<typename R> requires Integer_Operand<R>
+	Integer& operator+=(Integer& lhs, R const& rhs)
+	{
+		Int result;
+		if (lhs.is_small() && integer::is_small(rhs) && !__builtin_add_overflow(lhs.small, integer::small(rhs), &result)) [[likely]] {
+			lhs.small = result;
+			return lhs;
+		}
+		return lhs = add_slow(lhs, Integer(rhs));
+	}
+
+	template<typename R> requires Integer_Operand<R>
+	Integer& operator-=(Integer& lhs, R const& rhs)
+	{
+		Int result;
+		if (lhs.is_small() && integer::is_small(rhs) && !__builtin_sub_overflow(lhs.small, integer::small(rhs), &result)) [[likely]] {
+			lhs.small = result;
+			return lhs;
+		}
+		return lhs = sub_slow(lhs, Integer(rhs));
+	}
+
+	template<typename R> requires Integer_Operand<R>
+	Integer& operator*=(Integer& lhs, R const& rhs)
+	{
+		Int result;
+		if (lhs.is_small() && integer::is_small(rhs) && !__builtin_mul_overflow(lhs.small, integer::small(rhs), &result)) [[likely]] {
+			lhs.small = result;
+			return lhs;
+		}
+		return lhs = mul_slow(lhs, Integer(rhs));
+	}
+
+	template<typename R> requires Integer_Operand<R>
+	Integer& operator%=(Integer& lhs, R const& rhs)
+	{
+		return lhs = lhs % rhs;
+	}
+
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	bool operator==(L const& lhs, R const& rhs)
+	{
+		if (integer::is_small(lhs) && integer::is_small(rhs)) [[likely]] {
+			return integer::small(lhs) == integer::small(rhs);
+		}
+		return compare_slow(Integer(lhs), Integer(rhs)) == 0;
+	}
+
+	template<typename L, typename R> requires Integer_Operands<L, R>
+	std::strong_ordering operator<=>(L const& lhs, R const& rhs)
+	{
+		if (integer::is_small(lhs) && integer::is_small(rhs)) [[likely]] {
+			return integer::small(lhs) <=> integer::small(rhs);
+		}
+		return compare_slow(Integer(lhs), Integer(rhs));
+	}
+}
+
+/// Mixed native and Python integers, like in min(0, x), result in Integer
+template<std::integral T>
+struct std::common_type<python::Integer, T> { using type = python::Integer; };
+
+template<std::integral T>
+struct std::common_type<T, python::Integer> { using type = python::Integer; };
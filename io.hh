@@ -0,0 +1,120 @@
+#pragma once
+
+#include <cstddef>
+#include <cstring>
+#include <memory>
+#include <string_view>
+
+#include "str.hh"
+
+// Reading of files and standard input. Input is read in large blocks and
+// lines are returned as views into the buffer, so iteration over lines
+// copies only lines that outlive it and memory use doesn't depend on the
+// size of input. Reading syscalls live in runtime.cc.
+namespace python
+{
+	struct Reader
+	{
+		/// Size of single read, buffer grows only for longer lines
+		static constexpr std::size_t block = 1 << 20;
+
+		int fd;
+
+		/// File descriptor is closed with reader
+		bool owned;
+		bool closed = false;
+		bool eof = false;
+
+		/// \r\n and \r end lines like \n, as in files Python opens in text mode
+		bool universal_newlines = false;
+
+		/// Last block ended with \r, so \n starting the next one belongs to it
+		bool after_cr = false;
+
+		std::unique_ptr<char[]> buffer;
+		std::size_t capacity = block;
+
+		/// Unread data is [begin, end), [begin, scanned) doesn't contain newline
+		std::size_t begin = 0, scanned = 0, end = 0;
+
+		Reader(int fd, bool owned);
+		~Reader();
+
+		Reader(Reader const&) = delete;
+		Reader& operator=(Reader const&) = delete;
+
+		/// Next line including newline, valid until next read. Empty at the end of input.
+		std::string_view line()
+		{
+			for (;;) {
+				char *const data = buffer.get();
+				if (auto *newline = static_cast<char*>(std::memchr(data + scanned, '\n', end - scanned))) {
+					std::string_view const result(data + begin, newline + 1 - (data + begin));
+					begin = scanned = newline + 1 - data;
+					return result;
+				}
+				scanned = end;
+				if (!fill()) {
+					std::string_view const result(data + begin, end - begin);
+					begin = scanned = end;
+					return result;
+				}
+			}
+		}
+
+		/// Rest of the input
+		Str read();
+
+		void close();
+
+	private:
+		/// Reads next block after unread data, false at the end of input
+		bool fill();
+
+		/// Replaces line endings of n bytes read into data by \n, returns their new size
+		std::size_t translate_newlines(char *data, std::size_t n);
+	};
+
+	/// File opened for reading, shared by copies like Python's file objects
+	struct File
+	{
+		std::shared_ptr<Reader> reader;
+
+		/// Opens file for reading in text mode, raises OSError when it fails
+		static File open(std::string_view path, std::string_view mode);
+
+		struct Sentinel {};
+
+		struct Iterator
+		{
+			Reader *reader;
+			std::string_view current;
+
+			std::string_view operator*() const { return current; }
+			Iterator& operator++() { current = reader->line(); return *this; }
+			bool operator==(Sentinel) const { return current.empty(); }
+		};
+
+		Iterator begin() const
+		{
+			Reader &r = checked();
+			return { &r, r.line() };
+		}
+
+		Sentinel end() const { return {}; }
+
+		Str readline() const { return Str(checked().line()); }
+		Str read() const { return checked().read(); }
+		void close() const { if (reader) reader->close(); }
+
+	private:
+		/// Reader of open file, raises ValueError when file is closed
+		Reader& checked() const;
+	};
+
+	namespace sys
+	{
+		/// sys.stdin, shared with input()
+		File const& standard_input();
+	}
+}
@@ -0,0 +1,133 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <climits>
+#include <concepts>
+#include <cstddef>
+#include <cstring>
+#include <string_view>
+
+#include <unistd.h>
+
+// Buffered writer for standard output used by print(). Bypasses iostreams,
+// so formatting of every argument is a memcpy or std::to_chars into buffer.
+// Each thread has its own buffer and writes only whole lines, so threads
+// of parallel loops neither wait for each other nor interleave lines.
+namespace python
+{
+	struct Output
+	{
+		static constexpr std::size_t capacity = 64 * 1024;
+
+		int fd;
+
+		/// Flush on line boundaries, like Python does when stdout is a terminal
+		bool line_buffered;
+
+		/// Other threads write concurrently, set by parallel loops
+		bool concurrent = false;
+
+		std::size_t size = 0;
+		char buffer[capacity];
+
+		explicit Output(int fd)
+			: fd(fd), line_buffered(::isatty(fd))
+		{
+		}
+
+		Output(Output const&) = delete;
+		Output& operator=(Output const&) = delete;
+
+		~Output()
+		{
+			flush();
+		}
+
+		void write(std::string_view s)
+		{
+			if (s.size() >= capacity) {
+				flush();
+				write_all(s.data(), s.size());
+				return;
+			}
+			reserve(s.size());
+			std::memcpy(buffer + size, s.data(), s.size());
+			size += s.size();
+		}
+
+		void write(char c)
+		{
+			reserve(1);
+			buffer[size++] = c;
+		}
+
+		void write(std::integral auto value)
+		{
+			constexpr std::size_t max_digits = 24;
+			reserve(max_digits);
+			size = std::to_chars(buffer + size, buffer + capacity, value).ptr - buffer;
+		}
+
+		void flush()
+		{
+			write_lines(buffer, size);
+			size = 0;
+		}
+
+		/// Writes complete lines, keeping the last unfinished one
+		void flush_lines()
+		{
+			auto const end = std::string_view(buffer, size).rfind('\n') + 1;
+			if (end == 0) return;
+			write_lines(buffer, end);
+			std::memmove(buffer, buffer + end, size - end);
+			size -= end;
+		}
+
+	private:
+		/// Makes room for n bytes, splitting line only when it doesn't fit into buffer
+		void reserve(std::size_t n)
+		{
+			if (capacity - size >= n) [[likely]] return;
+			flush_lines();
+			if (capacity - size < n) flush();
+		}
+
+		/// Pipes write up to PIPE_BUF bytes atomically, so concurrent output
+		/// is split into such pieces on line boundaries
+		void write_lines(char const* data, std::size_t n)
+		{
+			while (concurrent && n > PIPE_BUF) {
+				std::string_view const rest(data, n);
+				auto piece = rest.substr(0, PIPE_BUF).rfind('\n') + 1;
+				// Lines longer than PIPE_BUF are written whole
+				if (piece == 0) piece = rest.find('\n') == std::string_view::npos ? n : rest.find('\n') + 1;
+				write_all(data, piece);
+				data += piece;
+				n -= piece;
+			}
+			write_all(data, n);
+		}
+
+		void write_all(char const* data, std::size_t n)
+		{
+			while (n > 0) {
+				auto const written = ::write(fd, data, n);
+				if (written < 0) {
+					if (errno == EINTR) continue;
+					return;
+				}
+				data += written;
+				n -= written;
+			}
+		}
+	};
+
+	/// Standard output of current thread, flushed when thread exits
+	inline Output& stdout_buffer()
+	{
+		thread_local Output out(STDOUT_FILENO);
+		return out;
+	}
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "integer.hh"
+
+// Parallel for loops over range(), marked by `# compy: parallel` comment.
+// Iterations are split into chunks, which are distributed evenly between
+// threads of the pool. Thread that runs out of chunks steals half of the
+// remaining chunks of another thread. Pool lives in runtime.cc.
+namespace python::parallel
+{
+	/// Threads available to parallel loop started by current thread.
+	/// Inside of parallel loop it's 1, so nested loops run serially.
+	std::size_t threads();
+
+	/// Current thread runs iterations of parallel loop
+	bool inside_loop();
+
+	/// Runs body(context, chunk) for each chunk in [0, count) on threads of the pool,
+	/// rethrows the first exception raised by body after all threads stopped
+	void run(std::size_t count, void (*body)(void*, std::size_t), void *context);
+
+	/// Iterations of range(start, stop, step) split into chunks of consecutive
+	/// iterations. Step must be validated by range_step().
+	struct Chunks
+	{
+		/// Enough chunks per thread to balance iterations of uneven cost
+		static constexpr std::size_t per_thread = 8;
+
+		Int start, stop, step;
+		std::uint64_t iterations;
+		std::size_t count;
+
+		Chunks(Int start, Int stop, Int step)
+			: start(start), stop(stop), step(step)
+		{
+			// Differences are computed in unsigned arithmetic, so they can't overflow
+			if (step > 0) {
+				iterations = start < stop ? (std::uint64_t(stop) - std::uint64_t(start) - 1) / std::uint64_t(step) + 1 : 0;
+			} else {
+				iterations = start > stop ? (std::uint64_t(start) - std::uint64_t(stop) - 1) / (std::uint64_t(0) - std::uint64_t(step)) + 1 : 0;
+			}
+			std::uint64_t const wanted = threads() * per_thread;
+			count = std::size_t(iterations < wanted ? iterations : wanted);
+		}
+
+		/// First value of chunk
+		Int from(std::size_t chunk) const
+		{
+			auto const iteration = std::uint64_t((unsigned __int128)(iterations) * chunk / count);
+			return Int(std::uint64_t(start) + std::uint64_t(step) * iteration);
+		}
+
+		/// Bound of chunk, excluded like stop of range()
+		Int to(std::size_t chunk) const
+		{
+			return chunk + 1 == count ? stop : from(chunk + 1);
+		}
+
+		/// Runs body(chunk, from(chunk), to(chunk)) for each chunk in parallel
+		template<typename Body>
+		void run(Body &&body) const
+		{
+			struct Context { Chunks const& chunks; Body &body; } context{ *this, body };
+			parallel::run(count, [](void *context, std::size_t chunk) {
+				auto &c = *static_cast<Context*>(context);
+				c.body(chunk, c.chunks.from(chunk), c.chunks.to(chunk));
+			}, &context);
+		}
+	};
+}
@@ -0,0 +1,217 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// Instrumentation of programs compiled with `compy --profile`. Functions
+// and loops are measured by RAII timers reading time stamp counter, results
+// are accumulated per thread and merged when thread exits. Report is written
+// to standard error at exit.
+namespace python::profile
+{
+	/// Allocations made by current thread, counted by operator new replaced
+	/// in runtime.cc when it's built with COMPY_PROFILE
+	inline constinit thread_local std::uint64_t allocations = 0;
+
+	inline std::uint64_t ticks()
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		return __rdtsc();
+#else
+		return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+	}
+
+	struct Counters
+	{
+		std::uint64_t calls = 0;
+
+		/// Time of outermost activations, so recursion isn't counted twice
+		std::uint64_t inclusive = 0;
+
+		/// Time and allocations excluding nested instrumented sites
+		std::uint64_t exclusive = 0;
+		std::uint64_t allocations = 0;
+
+		/// Active timers of site in current thread
+		std::uint32_t depth = 0;
+
+		Counters& operator+=(Counters const& other)
+		{
+			calls += other.calls;
+			inclusive += other.inclusive;
+			exclusive += other.exclusive;
+			allocations += other.allocations;
+			return *this;
+		}
+	};
+
+	/// Instrumented function or loop, identified by Python source line
+	struct Site
+	{
+		char const* name;
+		int line;
+		std::size_t index;
+
+		Site(char const* name, int line);
+	};
+
+	void report();
+
+	struct Registry
+	{
+		std::mutex mutex;
+		std::vector<Site const*> sites;
+
+		/// Counters of threads that already exited
+		std::vector<Counters> totals;
+
+		/// Calibration of ticks to wall time
+		std::uint64_t start_ticks = ticks();
+		std::chrono::steady_clock::time_point start_time = std::chrono::steady_clock::now();
+	};
+
+	/// Never destroyed, so it outlives report at exit and exiting threads
+	inline Registry& registry()
+	{
+		static Registry *instance = [] {
+			auto *r = new Registry;
+			std::atexit(report);
+			return r;
+		}();
+		return *instance;
+	}
+
+	inline Site::Site(char const* name, int line)
+		: name(name), line(line)
+	{
+		// Sites are registered inside of enclosing timers, which don't own the allocations
+		std::uint64_t const counted = allocations;
+		{
+			auto &r = registry();
+			std::lock_guard lock(r.mutex);
+			index = r.sites.size();
+			r.sites.push_back(this);
+			r.totals.emplace_back();
+		}
+		allocations = counted;
+	}
+
+	struct Thread_Counters
+	{
+		std::vector<Counters> counters;
+
+		Counters& operator[](std::size_t index)
+		{
+			if (index >= counters.size()) [[unlikely]] {
+				// Growth isn't attributed to running timers
+				std::uint64_t const counted = allocations;
+				counters.resize(index + 1);
+				allocations = counted;
+			}
+			return counters[index];
+		}
+
+		~Thread_Counters()
+		{
+			auto &r = registry();
+			std::lock_guard lock(r.mutex);
+			for (std::size_t i = 0; i < counters.size(); ++i) {
+				r.totals[i] += counters[i];
+			}
+		}
+	};
+
+	inline Thread_Counters& thread_counters()
+	{
+		thread_local Thread_Counters counters;
+		return counters;
+	}
+
+	struct Timer;
+	inline constinit thread_local Timer *current = nullptr;
+
+	/// Measures lifetime of scope as activation of site
+	struct Timer
+	{
+		Thread_Counters &thread;
+		std::size_t index;
+		Timer *parent;
+		std::uint64_t start_allocations, child_allocations = 0;
+		std::uint64_t child_ticks = 0;
+		std::uint64_t start;
+
+		explicit Timer(Site const& site)
+			: thread(thread_counters()), index(site.index), parent(current)
+		{
+			++thread[index].depth;
+			start_allocations = allocations;
+			current = this;
+			start = ticks();
+		}
+
+		Timer(Timer const&) = delete;
+		Timer& operator=(Timer const&) = delete;
+
+		~Timer()
+		{
+			std::uint64_t const elapsed = ticks() - start;
+			std::uint64_t const allocated = allocations - start_allocations;
+
+			// Nested sites may have grown counters, so they are looked up again
+			auto &counters = thread[index];
+			++counters.calls;
+			counters.exclusive += elapsed - child_ticks;
+			counters.allocations += allocated - child_allocations;
+			if (--counters.depth == 0) counters.inclusive += elapsed;
+
+			if (parent) {
+				parent->child_ticks += elapsed;
+				parent->child_allocations += allocated;
+			}
+			current = parent;
+		}
+	};
+
+	inline void report()
+	{
+		auto &r = registry();
+		std::lock_guard lock(r.mutex);
+
+		double const ms_per_tick = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - r.start_time).count()
+			/ double(std::max<std::uint64_t>(ticks() - r.start_ticks, 1));
+
+		// Specializations of generic functions have separate sites for the same line
+		struct Row { std::string_view name; int line; Counters counters; };
+		std::vector<Row> rows;
+		for (auto const* site : r.sites) {
+			auto row = std::find_if(rows.begin(), rows.end(), [&](Row const& row) { return row.name == site->name && row.line == site->line; });
+			if (row == rows.end()) {
+				rows.push_back({ site->name, site->line, {} });
+				row = rows.end() - 1;
+			}
+			row->counters += r.totals[site->index];
+		}
+		std::sort(rows.begin(), rows.end(), [](Row const& a, Row const& b) { return a.counters.exclusive > b.counters.exclusive; });
+
+		std::fprintf(stderr, "%12s %14s %14s %12s %6s  %s\n", "calls", "inclusive ms", "exclusive ms", "allocations", "line", "function");
+		for (auto const& row : rows) {
+			std::fprintf(stderr, "%12llu %14.3f %14.3f %12llu %6d  %.*s\n",
+				(unsigned long long)row.counters.calls,
+				row.counters.inclusive * ms_per_tick,
+				row.counters.exclusive * ms_per_tick,
+				(unsigned long long)row.counters.allocations,
+				row.line, int(row.name.size()), row.name.data());
+		}
+	}
+}
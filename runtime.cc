@@ -0,0 +1,1101 @@
+// Non-template parts of runtime, prebuilt by compy into libcompy_rt.a
+#include "std.hh"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace python
+{
+	void Error::print(std::ostream& os) const
+	{
+		os << type;
+		if (!message.empty()) os << ": " << message;
+		os << std::endl;
+	}
+}
+
+namespace python
+{
+	namespace
+	{
+		using Limbs = std::vector<std::uint32_t>;
+
+		void trim(Limbs &limbs)
+		{
+			while (!limbs.empty() && limbs.back() == 0) limbs.pop_back();
+		}
+
+		std::strong_ordering compare_magnitude(Limbs const& lhs, Limbs const& rhs)
+		{
+			if (lhs.size() != rhs.size()) return lhs.size() <=> rhs.size();
+			for (auto i = lhs.size(); i-- > 0;) {
+				if (lhs[i] != rhs[i]) return lhs[i] <=> rhs[i];
+			}
+			return std::strong_ordering::equal;
+		}
+
+		Limbs add_magnitude(Limbs const& lhs, Limbs const& rhs)
+		{
+			Limbs result(std::max(lhs.size(), rhs.size()) + 1);
+			std::uint64_t carry = 0;
+			for (std::size_t i = 0; i < result.size(); ++i) {
+				carry += std::uint64_t(i < lhs.size() ? lhs[i] : 0) + (i < rhs.size() ? rhs[i] : 0);
+				result[i] = std::uint32_t(carry);
+				carry >>= 32;
+			}
+			trim(result);
+			return result;
+		}
+
+		/// Requires lhs >= rhs
+		Limbs sub_magnitude(Limbs const& lhs, Limbs const& rhs)
+		{
+			Limbs result(lhs.size());
+			std::int64_t borrow = 0;
+			for (std::size_t i = 0; i < lhs.size(); ++i) {
+				std::int64_t diff = std::int64_t(lhs[i]) - (i < rhs.size() ? rhs[i] : 0) - borrow;
+				borrow = diff < 0;
+				result[i] = std::uint32_t(diff + (borrow << 32));
+			}
+			trim(result);
+			return result;
+		}
+
+		Limbs mul_magnitude(Limbs const& lhs, Limbs const& rhs)
+		{
+			if (lhs.empty() || rhs.empty()) return {};
+			Limbs result(lhs.size() + rhs.size());
+			for (std::size_t i = 0; i < lhs.size(); ++i) {
+				std::uint64_t carry = 0;
+				for (std::size_t j = 0; j < rhs.size(); ++j) {
+					carry += std::uint64_t(lhs[i]) * rhs[j] + result[i + j];
+					result[i + j] = std::uint32_t(carry);
+					carry >>= 32;
+				}
+				result[i + rhs.size()] = std::uint32_t(carry);
+			}
+			trim(result);
+			return result;
+		}
+
+		/// Divides magnitude in place, returns remainder
+		std::uint32_t div_magnitude(Limbs &limbs, std::uint32_t divisor)
+		{
+			std::uint64_t remainder = 0;
+			for (auto i = limbs.size(); i-- > 0;) {
+				std::uint64_t const current = (remainder << 32) | limbs[i];
+				limbs[i] = std::uint32_t(current / divisor);
+				remainder = current % divisor;
+			}
+			trim(limbs);
+			return std::uint32_t(remainder);
+		}
+
+		/// Requires nonzero rhs
+		Limbs mod_magnitude(Limbs const& lhs, Limbs const& rhs)
+		{
+			if (rhs.size() == 1) {
+				Limbs quotient = lhs;
+				std::uint32_t const remainder = div_magnitude(quotient, rhs[0]);
+				return remainder ? Limbs{remainder} : Limbs{};
+			}
+
+			// Shifts bits of lhs into remainder, most significant first
+			Limbs remainder;
+			for (auto bit = lhs.size() * 32; bit-- > 0;) {
+				std::uint32_t carry = (lhs[bit / 32] >> (bit % 32)) & 1;
+				for (auto &limb : remainder) {
+					std::uint32_t const next = limb >> 31;
+					limb = (limb << 1) | carry;
+					carry = next;
+				}
+				if (carry) remainder.push_back(carry);
+				if (compare_magnitude(remainder, rhs) >= 0) remainder = sub_magnitude(remainder, rhs);
+			}
+			return remainder;
+		}
+
+		std::uint64_t low_magnitude(Limbs const& limbs)
+		{
+			std::uint64_t result = 0;
+			for (auto i = limbs.size(); i-- > 0;) result = (result << 32) | limbs[i];
+			return result;
+		}
+
+		BigInt make(bool negative, Limbs limbs)
+		{
+			BigInt result;
+			result.negative = negative && !limbs.empty();
+			result.limbs = std::move(limbs);
+			return result;
+		}
+	}
+
+	BigInt::BigInt(Int value)
+		: negative(value < 0)
+	{
+		std::uint64_t magnitude = negative ? ~std::uint64_t(value) + 1 : std::uint64_t(value);
+		for (; magnitude != 0; magnitude >>= 32) {
+			limbs.push_back(std::uint32_t(magnitude));
+		}
+	}
+
+	BigInt::BigInt(std::string_view digits)
+	{
+		bool const minus = !digits.empty() && digits.front() == '-';
+		if (minus) digits.remove_prefix(1);
+
+		for (char c : digits) {
+			// limbs = limbs * 10 + digit
+			std::uint64_t carry = c - '0';
+			for (auto &limb : limbs) {
+				carry += std::uint64_t(limb) * 10;
+				limb = std::uint32_t(carry);
+				carry >>= 32;
+			}
+			if (carry) limbs.push_back(std::uint32_t(carry));
+		}
+		trim(limbs);
+		negative = minus && !limbs.empty();
+	}
+
+	bool BigInt::fits_int() const
+	{
+		if (limbs.size() > 2) return false;
+		std::uint64_t const magnitude = low_magnitude(limbs);
+		return magnitude <= std::uint64_t(INT64_MAX) + negative;
+	}
+
+	Int BigInt::to_int() const
+	{
+		std::uint64_t const magnitude = low_magnitude(limbs);
+		return Int(negative ? ~magnitude + 1 : magnitude);
+	}
+
+	std::string BigInt::to_string() const
+	{
+		if (limbs.empty()) return "0";
+
+		// Peel off groups of 9 decimal digits, least significant first
+		std::vector<std::uint32_t> groups;
+		for (Limbs magnitude = limbs; !magnitude.empty();) {
+			groups.push_back(div_magnitude(magnitude, 1'000'000'000));
+		}
+
+		std::string result = negative ? "-" : "";
+		result += std::to_string(groups.back());
+		for (auto i = groups.size() - 1; i-- > 0;) {
+			auto const group = std::to_string(groups[i]);
+			result.append(9 - group.size(), '0');
+			result += group;
+		}
+		return result;
+	}
+
+	BigInt BigInt::operator-() const
+	{
+		return make(!negative, limbs);
+	}
+
+	BigInt operator+(BigInt const& lhs, BigInt const& rhs)
+	{
+		if (lhs.negative == rhs.negative) {
+			return make(lhs.negative, add_magnitude(lhs.limbs, rhs.limbs));
+		}
+		if (compare_magnitude(lhs.limbs, rhs.limbs) >= 0) {
+			return make(lhs.negative, sub_magnitude(lhs.limbs, rhs.limbs));
+		}
+		return make(rhs.negative, sub_magnitude(rhs.limbs, lhs.limbs));
+	}
+
+	BigInt operator-(BigInt const& lhs, BigInt const& rhs)
+	{
+		return lhs + -rhs;
+	}
+
+	BigInt operator*(BigInt const& lhs, BigInt const& rhs)
+	{
+		return make(lhs.negative != rhs.negative, mul_magnitude(lhs.limbs, rhs.limbs));
+	}
+
+	BigInt operator%(BigInt const& lhs, BigInt const& rhs)
+	{
+		Limbs magnitude = mod_magnitude(lhs.limbs, rhs.limbs);
+		if (!magnitude.empty() && lhs.negative != rhs.negative) {
+			magnitude = sub_magnitude(rhs.limbs, magnitude);
+		}
+		return make(rhs.negative, std::move(magnitude));
+	}
+
+	std::strong_ordering operator<=>(BigInt const& lhs, BigInt const& rhs)
+	{
+		if (lhs.negative != rhs.negative) {
+			return rhs.negative <=> lhs.negative;
+		}
+		auto const magnitude = compare_magnitude(lhs.limbs, rhs.limbs);
+		return lhs.negative ? 0 <=> magnitude : magnitude;
+	}
+
+	void throw_overflow_error()
+	{
+		throw overflow_error("cannot fit 'int' into an index-sized integer");
+	}
+
+	void throw_key_error(Value const& key)
+	{
+		std::ostringstream message;
+		Stream_Sink sink{message};
+		repr(sink, key);
+		throw key_error(message.str());
+	}
+
+	void throw_index_error(char const* message)
+	{
+		throw index_error(message);
+	}
+
+	void throw_memory_error()
+	{
+		throw memory_error("");
+	}
+
+	Slice::Range Slice::range(std::size_t size) const
+	{
+		Int const n = size, by = step.value_or(1);
+		if (by == 0) throw value_error("slice step cannot be zero");
+
+		// Negative bounds count from the end, then they're clamped like in CPython
+		auto const bound = [&](std::optional<Int> const& value, Int def, Int low, Int high) {
+			if (!value) return def;
+			Int const i = *value < 0 ? *value + n : *value;
+			return std::clamp(i, low, high);
+		};
+		Int from, to;
+		if (by > 0) {
+			from = bound(start, 0, 0, n);
+			to = bound(stop, n, 0, n);
+		} else {
+			from = bound(start, n - 1, -1, n - 1);
+			to = bound(stop, -1, -1, n - 1);
+		}
+		std::size_t length = 0;
+		if (by > 0 && from < to) length = (to - from - 1) / by + 1;
+		if (by < 0 && from > to) length = (from - to - 1) / -by + 1;
+		return { from, by, length };
+	}
+
+	Str Str::slice(Slice const& bounds) const
+	{
+		auto const [start, step, length] = bounds.range(size());
+		char const *first = data() + start;
+		if (step == 1 && length > inline_capacity) {
+			Str result;
+			large.buffer->references.fetch_add(1, std::memory_order_relaxed);
+			result.set_large(first, large.buffer, length);
+			return result;
+		}
+		return build(length, [&](char *p) {
+			for (std::size_t i = 0; i < length; ++i) p[i] = first[std::ptrdiff_t(i) * step];
+		});
+	}
+
+	List List::slice(Slice const& bounds) const
+	{
+		allocation::Scope scope(allocation::Category::List);
+		auto const [start, step, length] = bounds.range(size());
+		List result;
+		result.reserve(length);
+		for (std::size_t i = 0; i < length; ++i) {
+			result.push_back(std::vector<Value>::operator[](start + std::ptrdiff_t(i) * step));
+		}
+		return result;
+	}
+
+	void Str::append_slow(std::string_view s)
+	{
+		auto const n = size(), total = n + s.size();
+		bool const owned = is_inline() || unique();
+		auto const capacity = owned ? std::max(total, 2 * (is_inline() ? n : large.buffer->capacity)) : total;
+		Buffer *buffer = allocate(capacity);
+		std::memcpy(buffer->bytes(), data(), n);
+		std::memcpy(buffer->bytes() + n, s.data(), s.size());
+		if (!is_inline()) release(large.buffer);
+		set_large(buffer->bytes(), buffer, total);
+	}
+
+	Integer::Integer(BigInt value)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		if (value.fits_int()) {
+			small = value.to_int();
+		} else {
+			big = std::make_shared<BigInt const>(std::move(value));
+		}
+	}
+
+	Integer add_slow(Integer const& lhs, Integer const& rhs)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		return lhs.to_big() + rhs.to_big();
+	}
+
+	Integer sub_slow(Integer const& lhs, Integer const& rhs)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		return lhs.to_big() - rhs.to_big();
+	}
+
+	Integer mul_slow(Integer const& lhs, Integer const& rhs)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		return lhs.to_big() * rhs.to_big();
+	}
+
+	Integer mod_slow(Integer const& lhs, Integer const& rhs)
+	{
+		if (!rhs) throw zero_division_error("integer modulo by zero");
+		if (lhs.is_small() && rhs.is_small()) {
+			// Remainder of INT64_MIN % -1 is 0, but the division overflows
+			if (rhs.small == -1) return 0;
+			Int const result = lhs.small % rhs.small;
+			return result != 0 && (result < 0) != (rhs.small < 0) ? result + rhs.small : result;
+		}
+		allocation::Scope scope(allocation::Category::BigInt);
+		return lhs.to_big() % rhs.to_big();
+	}
+
+	Integer neg_slow(Integer const& value)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		return -value.to_big();
+	}
+
+	std::strong_ordering compare_slow(Integer const& lhs, Integer const& rhs)
+	{
+		allocation::Scope scope(allocation::Category::BigInt);
+		return lhs.to_big() <=> rhs.to_big();
+	}
+}
+
+namespace python::value
+{
+	Slow_Path_Counters slow_paths{};
+
+	void report_slow_paths(std::ostream& os)
+	{
+		os << "Value operations that missed Int fast path:"
+			<< " add=" << slow_paths.add.load()
+			<< " sub=" << slow_paths.sub.load()
+			<< " mul=" << slow_paths.mul.load()
+			<< " mod=" << slow_paths.mod.load()
+			<< " neg=" << slow_paths.neg.load()
+			<< " compare=" << slow_paths.compare.load()
+			<< " equal=" << slow_paths.equal.load() << '\n';
+	}
+
+	namespace
+	{
+		void count(std::atomic<std::uint64_t> &counter)
+		{
+			counter.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		char const* type_name(Value const& value)
+		{
+			return python::visit(overloaded{
+				[](struct None) { return "NoneType"; },
+				[](Bool) { return "bool"; },
+				[](Int) { return "int"; },
+				[](BigInt const&) { return "int"; },
+				[](Str const&) { return "str"; },
+				[](List const&) { return "list"; },
+				[](Dict const&) { return "dict"; },
+				[](Set const&) { return "set"; }
+			}, value);
+		}
+
+		/// Value of bool or int as Integer
+		std::optional<Integer> numeric(Value const& value)
+		{
+			return python::visit(overloaded{
+				[](Bool b) -> std::optional<Integer> { return Integer(Int(b)); },
+				[](Int i) -> std::optional<Integer> { return Integer(i); },
+				[](BigInt const& i) -> std::optional<Integer> { return Integer(i); },
+				[](auto const&) -> std::optional<Integer> { return std::nullopt; }
+			}, value);
+		}
+
+		[[noreturn]] void unsupported(char const* op, Value const& lhs, Value const& rhs)
+		{
+			throw type_error(std::string("unsupported operand type(s) for ") + op + ": '"
+				+ type_name(lhs) + "' and '" + type_name(rhs) + "'");
+		}
+	}
+
+	Value add_slow(Value const& lhs, Value const& rhs)
+	{
+		count(slow_paths.add);
+		if (auto l = numeric(lhs), r = numeric(rhs); l && r) return *l + *r;
+		if (auto l = get_if<Str>(&lhs), r = get_if<Str>(&rhs); l && r) return *l + *r;
+		if (auto l = get_if<List>(&lhs), r = get_if<List>(&rhs); l && r) return List(*l) += List(*r);
+		unsupported("+", lhs, rhs);
+	}
+
+	Value sub_slow(Value const& lhs, Value const& rhs)
+	{
+		count(slow_paths.sub);
+		if (auto l = numeric(lhs), r = numeric(rhs); l && r) return *l - *r;
+		unsupported("-", lhs, rhs);
+	}
+
+	Value mul_slow(Value const& lhs, Value const& rhs)
+	{
+		count(slow_paths.mul);
+		auto const l = numeric(lhs), r = numeric(rhs);
+		if (l && r) return *l * *r;
+		if (auto s = get_if<Str>(&lhs); s && r) return *s * Int(*r);
+		if (auto s = get_if<Str>(&rhs); s && l) return *s * Int(*l);
+		if (auto list = get_if<List>(&lhs); list && r) return ::operator*(*list, Int(*r));
+		if (auto list = get_if<List>(&rhs); list && l) return ::operator*(*list, Int(*l));
+		unsupported("*", lhs, rhs);
+	}
+
+	Value mod_slow(Value const& lhs, Value const& rhs)
+	{
+		count(slow_paths.mod);
+		if (auto l = numeric(lhs), r = numeric(rhs); l && r) return *l % *r;
+		unsupported("%", lhs, rhs);
+	}
+
+	Value neg_slow(Value const& operand)
+	{
+		count(slow_paths.neg);
+		if (auto n = numeric(operand)) return -*n;
+		throw type_error(std::string("bad operand type for unary -: '") + type_name(operand) + "'");
+	}
+
+	int compare_slow(Value const& lhs, Value const& rhs, char const* op)
+	{
+		count(slow_paths.compare);
+		auto const sign = [](auto const& ordering) { return (ordering > 0) - (ordering < 0); };
+
+		if (auto l = numeric(lhs), r = numeric(rhs); l && r) return sign(*l <=> *r);
+		if (auto l = get_if<Str>(&lhs), r = get_if<Str>(&rhs); l && r) return sign(*l <=> *r);
+		if (auto l = get_if<List>(&lhs), r = get_if<List>(&rhs); l && r) {
+			// Lexicographical, with first unequal elements deciding
+			auto const [a, b] = std::mismatch(l->begin(), l->end(), r->begin(), r->end());
+			if (a != l->end() && b != r->end()) return compare(*a, *b, op);
+			return sign(l->size() <=> r->size());
+		}
+		throw type_error(std::string("'") + op + "' not supported between instances of '"
+			+ type_name(lhs) + "' and '" + type_name(rhs) + "'");
+	}
+
+	bool equal_slow(Value const& lhs, Value const& rhs)
+	{
+		count(slow_paths.equal);
+		if (auto l = numeric(lhs), r = numeric(rhs); l && r) return *l == *r;
+		return python::visit(overloaded{
+			[](struct python::None, struct python::None) { return true; },
+			[](Str const& lhs, Str const& rhs) { return lhs == rhs; },
+			[](List const& lhs, List const& rhs) { return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()); },
+			[](Dict const& lhs, Dict const& rhs) { return lhs == rhs; },
+			[](Set const& lhs, Set const& rhs) { return lhs == rhs; },
+			[](auto const&, auto const&) { return false; }
+		}, lhs, rhs);
+	}
+
+	std::size_t hash_slow(Value const& value)
+	{
+		return python::visit(overloaded{
+			[](struct python::None) -> std::size_t { return mix(0x9e3779b97f4a7c15); },
+			[](Bool b) -> std::size_t { return mix(b); },
+			[](Int i) -> std::size_t { return mix(i); },
+			[](BigInt const& i) -> std::size_t {
+				if (i.fits_int()) return mix(i.to_int());
+				std::size_t h = i.negative;
+				for (auto limb : i.limbs) h = mix(h ^ limb);
+				return h;
+			},
+			[](Str const& s) -> std::size_t { return hash(s.view()); },
+			[&](auto const&) -> std::size_t {
+				throw type_error(std::string("unhashable type: '") + type_name(value) + "'");
+			}
+		}, value);
+	}
+}
+
+list operator*(list const& l, python::Int n)
+{
+	python::allocation::Scope scope(python::allocation::Category::List);
+	list result;
+	auto const count = python::repeat_count(l.size(), n, result.max_size());
+	result.reserve(l.size() * count);
+
+	for (std::size_t i = 0; i < count; ++i) {
+		result.insert(result.end(), l.begin(), l.end());
+	}
+
+	return result;
+}
+
+list operator+(list lhs, list rhs)
+{
+	return lhs += std::move(rhs);
+}
+
+bool operator==(any const& lhs, list const& rhs)
+{
+	return python::visit(python::overloaded{
+		[&](list const& lhs) { return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()); },
+		[](auto const&) { return false; }
+	}, static_cast<python::Value_Variant const&>(lhs));
+}
+
+std::ostream& operator<<(std::ostream& os, list const& p)
+{
+	python::Stream_Sink sink{os};
+	python::format(sink, p);
+	return os;
+}
+
+std::ostream& operator<<(std::ostream& os, any const& val)
+{
+	python::Stream_Sink sink{os};
+	python::format(sink, val);
+	return os;
+}
+
+python::Str operator"" _str(char const* str, unsigned long length)
+{
+	return { str, length };
+}
+
+python::Int len(any const& val)
+{
+	return python::assert_type<python::List>(val, "len() expects iterable object").size();
+}
+
+python::Integer sum(list const& list)
+{
+	python::Integer result = 0;
+	for (auto const& element : list) {
+		if (auto big = python::get_if<python::BigInt>(&element); big) {
+			result += python::Integer(*big);
+		} else {
+			result += python::assert_type<python::Int>(element, "unsupported operand type for sum()");
+		}
+	}
+	return result;
+}
+
+#ifdef COMPY_TRACK_ALLOCATIONS
+namespace python::allocation
+{
+	namespace
+	{
+		struct Counters
+		{
+			std::atomic<std::uint64_t> allocations{}, bytes{};
+			std::atomic<std::int64_t> live_bytes{}, peak_live_bytes{};
+
+			void allocated(std::size_t size)
+			{
+				allocations.fetch_add(1, std::memory_order_relaxed);
+				bytes.fetch_add(size, std::memory_order_relaxed);
+				auto const live = live_bytes.fetch_add(size, std::memory_order_relaxed) + std::int64_t(size);
+				for (auto peak = peak_live_bytes.load(std::memory_order_relaxed); live > peak;) {
+					if (peak_live_bytes.compare_exchange_weak(peak, live, std::memory_order_relaxed)) break;
+				}
+			}
+
+			void freed(std::size_t size)
+			{
+				live_bytes.fetch_sub(size, std::memory_order_relaxed);
+			}
+		};
+
+		Counters total;
+		Counters categories[std::size_t(Category::Count)];
+
+		/// Precedes every block, so delete knows what it frees
+		struct alignas(__STDCPP_DEFAULT_NEW_ALIGNMENT__) Header
+		{
+			std::size_t size;
+			Category category;
+		};
+
+		void write_counters(std::FILE *out, Counters const& c)
+		{
+			std::fprintf(out, "{\"allocations\": %llu, \"bytes\": %llu, \"peak_live_bytes\": %lld}",
+				(unsigned long long)c.allocations.load(), (unsigned long long)c.bytes.load(), (long long)c.peak_live_bytes.load());
+		}
+
+		/// Written as JSON into file named by COMPY_ALLOCATIONS_JSON, used by
+		/// `compy --bench`, otherwise as a table to standard error
+		void report()
+		{
+			if (char const* path = std::getenv("COMPY_ALLOCATIONS_JSON")) {
+				std::FILE *out = std::fopen(path, "w");
+				if (!out) return;
+				std::fprintf(out, "{\"total\": ");
+				write_counters(out, total);
+				for (std::size_t i = 0; i < std::size_t(Category::Count); ++i) {
+					std::fprintf(out, ", \"%s\": ", category_names[i]);
+					write_counters(out, categories[i]);
+				}
+				std::fprintf(out, "}\n");
+				std::fclose(out);
+				return;
+			}
+
+			std::fprintf(stderr, "%-18s %12s %14s %16s\n", "allocations", "count", "bytes", "peak live bytes");
+			for (std::size_t i = 0; i < std::size_t(Category::Count); ++i) {
+				auto const& c = categories[i];
+				std::fprintf(stderr, "%-18s %12llu %14llu %16lld\n", category_names[i],
+					(unsigned long long)c.allocations.load(), (unsigned long long)c.bytes.load(), (long long)c.peak_live_bytes.load());
+			}
+			std::fprintf(stderr, "%-18s %12llu %14llu %16lld\n", "total",
+				(unsigned long long)total.allocations.load(), (unsigned long long)total.bytes.load(), (long long)total.peak_live_bytes.load());
+		}
+
+		[[maybe_unused]] int const registered = std::atexit(report);
+	}
+
+	void* allocate(std::size_t size)
+	{
+		auto *header = static_cast<Header*>(std::malloc(sizeof(Header) + size));
+		if (!header) [[unlikely]] throw std::bad_alloc();
+		header->size = size;
+		header->category = current;
+		total.allocated(size);
+		categories[std::size_t(current)].allocated(size);
+		return header + 1;
+	}
+
+	void deallocate(void *p)
+	{
+		if (!p) return;
+		auto *header = static_cast<Header*>(p) - 1;
+		total.freed(header->size);
+		categories[std::size_t(header->category)].freed(header->size);
+		std::free(header);
+	}
+}
+#endif
+
+namespace python::parallel
+{
+	namespace
+	{
+		/// Set in threads running parallel loop, so nested loops run serially
+		constinit thread_local bool in_loop = false;
+
+		/// Chunks [next, end) owned by single thread, taken by owner from the front
+		/// and stolen by other threads from the back
+		struct Slice
+		{
+			std::mutex mutex;
+			std::size_t next = 0, end = 0;
+		};
+
+		struct Job
+		{
+			void (*body)(void*, std::size_t);
+			void *context;
+			std::vector<Slice> slices;
+
+			std::atomic<bool> failed = false;
+			std::mutex exception_mutex;
+			std::exception_ptr exception;
+
+			Job(void (*body)(void*, std::size_t), void *context, std::size_t threads)
+				: body(body), context(context), slices(threads)
+			{
+			}
+
+			std::optional<std::size_t> take(std::size_t thread)
+			{
+				{
+					auto &own = slices[thread];
+					std::lock_guard lock(own.mutex);
+					if (own.next < own.end) return own.next++;
+				}
+				for (std::size_t i = 1; i < slices.size(); ++i) {
+					std::size_t from, to;
+					{
+						auto &victim = slices[(thread + i) % slices.size()];
+						std::lock_guard lock(victim.mutex);
+						if (victim.next == victim.end) continue;
+						to = victim.end;
+						from = victim.end -= (victim.end - victim.next + 1) / 2;
+					}
+					// Slice of thread is empty, so nobody else touches it
+					auto &own = slices[thread];
+					std::lock_guard lock(own.mutex);
+					own.next = from + 1;
+					own.end = to;
+					return from;
+				}
+				return std::nullopt;
+			}
+
+			void work(std::size_t thread)
+			{
+				while (!failed.load(std::memory_order_relaxed)) {
+					auto const chunk = take(thread);
+					if (!chunk) return;
+					try {
+						body(context, *chunk);
+					} catch (...) {
+						std::lock_guard lock(exception_mutex);
+						if (!exception) exception = std::current_exception();
+						failed = true;
+					}
+				}
+			}
+		};
+
+		std::size_t configured_threads()
+		{
+			if (char const* threads = std::getenv("COMPY_THREADS")) {
+				if (auto n = std::strtoul(threads, nullptr, 10); n > 0) return n;
+			}
+			return std::max(1u, std::thread::hardware_concurrency());
+		}
+
+		struct Pool
+		{
+			std::vector<std::thread> workers;
+
+			std::mutex mutex;
+			std::condition_variable wake, finished;
+			Job *job = nullptr;
+			std::uint64_t generation = 0;
+			std::size_t active = 0;
+			bool stopping = false;
+
+			/// Caller of run() is one of the threads
+			explicit Pool(std::size_t threads)
+			{
+				for (std::size_t i = 1; i < threads; ++i) {
+					workers.emplace_back([this, i] { worker(i); });
+				}
+			}
+
+			/// Joined at exit, so profile counters of workers are merged before report
+			~Pool()
+			{
+				{
+					std::lock_guard lock(mutex);
+					stopping = true;
+				}
+				wake.notify_all();
+				for (auto &worker : workers) worker.join();
+			}
+
+			void worker(std::size_t thread)
+			{
+				in_loop = true;
+				stdout_buffer().concurrent = true;
+				std::uint64_t seen = 0;
+				for (;;) {
+					Job *current;
+					{
+						std::unique_lock lock(mutex);
+						wake.wait(lock, [&] { return stopping || generation != seen; });
+						if (stopping) return;
+						seen = generation;
+						current = job;
+					}
+					current->work(thread);
+					// Output of loop precedes output that follows it
+					stdout_buffer().flush();
+					std::lock_guard lock(mutex);
+					if (--active == 0) finished.notify_one();
+				}
+			}
+
+			void run(Job &next)
+			{
+				// Output that precedes loop is written before output of workers
+				auto &out = stdout_buffer();
+				out.flush();
+				{
+					std::lock_guard lock(mutex);
+					job = &next;
+					++generation;
+					active = workers.size();
+				}
+				wake.notify_all();
+
+				in_loop = out.concurrent = true;
+				next.work(0);
+				in_loop = out.concurrent = false;
+
+				std::unique_lock lock(mutex);
+				finished.wait(lock, [&] { return active == 0; });
+				job = nullptr;
+			}
+		};
+
+		Pool& pool()
+		{
+			static Pool instance(configured_threads());
+			return instance;
+		}
+	}
+
+	std::size_t threads()
+	{
+		return in_loop ? 1 : pool().workers.size() + 1;
+	}
+
+	bool inside_loop()
+	{
+		return in_loop;
+	}
+
+	void run(std::size_t count, void (*body)(void*, std::size_t), void *context)
+	{
+		if (in_loop || count <= 1 || pool().workers.empty()) {
+			for (std::size_t chunk = 0; chunk < count; ++chunk) body(context, chunk);
+			return;
+		}
+
+		auto &p = pool();
+		Job job(body, context, p.workers.size() + 1);
+		for (std::size_t i = 0; i < job.slices.size(); ++i) {
+			job.slices[i].next = count * i / job.slices.size();
+			job.slices[i].end = count * (i + 1) / job.slices.size();
+		}
+		p.run(job);
+		if (job.exception) std::rethrow_exception(job.exception);
+	}
+}
+
+namespace python
+{
+	Reader::Reader(int fd, bool owned)
+		: fd(fd), owned(owned), buffer(new char[block])
+	{
+	}
+
+	Reader::~Reader()
+	{
+		close();
+	}
+
+	bool Reader::fill()
+	{
+		if (eof) return false;
+
+		// Unread data moves to the front, so buffer only grows for lines longer than it
+		char *data = buffer.get();
+		std::memmove(data, data + begin, end - begin);
+		end -= begin;
+		scanned -= begin;
+		begin = 0;
+		if (end == capacity) {
+			auto bigger = std::make_unique<char[]>(capacity * 2);
+			std::memcpy(bigger.get(), data, end);
+			buffer = std::move(bigger);
+			capacity *= 2;
+		}
+
+		for (;;) {
+			auto const n = ::read(fd, buffer.get() + end, capacity - end);
+			if (n > 0) {
+				end += universal_newlines ? translate_newlines(buffer.get() + end, n) : n;
+				return true;
+			}
+			if (n == 0) {
+				eof = true;
+				return false;
+			}
+			if (errno != EINTR) throw os_error(std::strerror(errno));
+		}
+	}
+
+	std::size_t Reader::translate_newlines(char *data, std::size_t n)
+	{
+		char const *in = data, *const stop = data + n;
+		if (after_cr && *in == '\n') ++in;
+		after_cr = false;
+
+		char *out = data;
+		while (in != stop) {
+			auto const *cr = static_cast<char const*>(std::memchr(in, '\r', stop - in));
+			auto const length = (cr ? cr : stop) - in;
+			if (out != in) std::memmove(out, in, length);
+			out += length;
+			in += length;
+			if (!cr) break;
+
+			*out++ = '\n';
+			if (++in == stop) after_cr = true;
+			else if (*in == '\n') ++in;
+		}
+		return out - data;
+	}
+
+	Str Reader::read()
+	{
+		while (fill()) {}
+		Str result(std::string_view(buffer.get() + begin, end - begin));
+		begin = scanned = end;
+		return result;
+	}
+
+	void Reader::close()
+	{
+		if (owned && !closed) ::close(fd);
+		closed = true;
+	}
+
+	File File::open(std::string_view path, std::string_view mode)
+	{
+		if (mode != "r" && mode != "rt") {
+			throw value_error("Only reading of text files is supported, got mode '" + std::string(mode) + "'");
+		}
+
+		std::string const name(path);
+		int const fd = ::open(name.c_str(), O_RDONLY | O_CLOEXEC);
+		if (fd < 0) {
+			auto const message = "[Errno " + std::to_string(errno) + "] " + std::strerror(errno) + ": '" + name + "'";
+			if (errno == ENOENT) throw file_not_found_error(message);
+			if (errno == EACCES) throw permission_error(message);
+			throw os_error(message);
+		}
+		::posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+		auto reader = std::make_shared<Reader>(fd, true);
+		reader->universal_newlines = true;
+		return File{ std::move(reader) };
+	}
+
+	Reader& File::checked() const
+	{
+		if (!reader || reader->closed) throw value_error("I/O operation on closed file.");
+		return *reader;
+	}
+
+	File const& sys::standard_input()
+	{
+		static File const file{ std::make_shared<Reader>(STDIN_FILENO, false) };
+		return file;
+	}
+}
+
+python::Str input()
+{
+	// Like Python, pending output is written before waiting for input
+	python::stdout_buffer().flush();
+	auto line = python::sys::standard_input().readline();
+	if (line.empty()) throw python::eof_error("EOF when reading a line");
+	return line.view().back() == '\n' ? line.slice({ .stop = -1 }) : line;
+}
+
+python::Str input(python::Str const& prompt)
+{
+	python::stdout_buffer().write(std::string_view(prompt));
+	return input();
+}
+
+#if defined(COMPY_PROFILE) || defined(COMPY_TRACK_ALLOCATIONS)
+// Replaced to count allocations for --profile reports and tracking
+void* operator new(std::size_t size)
+{
+#ifdef COMPY_PROFILE
+	++python::profile::allocations;
+#endif
+#ifdef COMPY_TRACK_ALLOCATIONS
+	return python::allocation::allocate(size);
+#else
+	if (void *p = std::malloc(size ? size : 1)) [[likely]] {
+		return p;
+	}
+	throw std::bad_alloc();
+#endif
+}
+
+// Kept out of line, so GCC doesn't report free() of memory from replaced
+// operator new as mismatched deallocation where both are inlined
+[[gnu::noinline]] void operator delete(void *p) noexcept
+{
+#ifdef COMPY_TRACK_ALLOCATIONS
+	python::allocation::deallocate(p);
+#else
+	std::free(p);
+#endif
+}
+
+void operator delete(void *p, std::size_t) noexcept
+{
+	operator delete(p);
+}
+
+namespace
+{
+	/// Default resource of libstdc++ allocates inside of the shared library,
+	/// which bypasses replaced operator new
+	struct New_Delete_Resource : std::pmr::memory_resource
+	{
+		void* do_allocate(std::size_t bytes, std::size_t alignment) override
+		{
+			// Only typed lists use polymorphic allocators
+			python::allocation::Scope scope(python::allocation::Category::List);
+			if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+				return ::operator new(bytes, std::align_val_t(alignment));
+			}
+			return ::operator new(bytes);
+		}
+
+		void do_deallocate(void *p, std::size_t bytes, std::size_t alignment) override
+		{
+			if (alignment > __STDCPP_DEFAULT_NEW_ALIGNMENT__) {
+				::operator delete(p, bytes, std::align_val_t(alignment));
+			} else {
+				::operator delete(p, bytes);
+			}
+		}
+
+		bool do_is_equal(std::pmr::memory_resource const& other) const noexcept override
+		{
+			return this == &other;
+		}
+	} new_delete_resource;
+}
+#endif
+
+int main()
+{
+#if defined(COMPY_PROFILE) || defined(COMPY_TRACK_ALLOCATIONS)
+	std::pmr::set_default_resource(&new_delete_resource);
+#endif
+
+	if (std::getenv("COMPY_SLOW_PATHS")) {
+		std::atexit([] { python::value::report_slow_paths(std::cerr); });
+	}
+
+	try {
+		compy_main();
+	} catch (python::Error const& error) {
+		python::stdout_buffer().flush();
+		error.print(std::cerr);
+		return 1;
+	} catch (std::bad_alloc const&) {
+		python::stdout_buffer().flush();
+		python::memory_error("").print(std::cerr);
+		return 1;
+	}
+}
@@ -0,0 +1,358 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPY_SIMD_X86
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define COMPY_SIMD_NEON
+#endif
+
+// Kernels operating on contiguous arrays of integers, used by typed lists.
+// On x86 AVX2 versions are compiled regardless of target flags and selected
+// at runtime based on CPU features, NEON is always available on ARM64.
+namespace python::simd
+{
+	struct Features
+	{
+		bool avx2 = false;
+	};
+
+	inline Features const& features()
+	{
+		static Features const detected = [] {
+			Features f;
+#ifdef COMPY_SIMD_X86
+			__builtin_cpu_init();
+			f.avx2 = __builtin_cpu_supports("avx2");
+#endif
+			return f;
+		}();
+		return detected;
+	}
+
+	namespace scalar
+	{
+		template<typename T>
+		std::size_t find(T const* data, std::size_t n, T value)
+		{
+			return std::find(data, data + n, value) - data;
+		}
+
+		template<typename T>
+		bool equal(T const* lhs, T const* rhs, std::size_t n)
+		{
+			return std::equal(lhs, lhs + n, rhs);
+		}
+
+		template<typename T>
+		bool sum(T const* data, std::size_t n, T& result)
+		{
+			T total{};
+			for (std::size_t i = 0; i < n; ++i) {
+				if (__builtin_add_overflow(total, data[i], &total)) return false;
+			}
+			result = total;
+			return true;
+		}
+
+		/// Combines partial sums of lanes with sum of remaining elements
+		template<typename T, std::size_t lanes>
+		bool sum_lanes(T const (&partial)[lanes], T const* data, std::size_t n, T& result)
+		{
+			T lanes_total, tail_total;
+			return sum(partial, lanes, lanes_total) && sum(data, n, tail_total)
+				&& !__builtin_add_overflow(lanes_total, tail_total, &result);
+		}
+
+		template<typename T>
+		T min(T const* data, std::size_t n)
+		{
+			return *std::min_element(data, data + n);
+		}
+
+		template<typename T>
+		T max(T const* data, std::size_t n)
+		{
+			return *std::max_element(data, data + n);
+		}
+	}
+
+#ifdef COMPY_SIMD_X86
+	namespace avx2
+	{
+		template<typename T>
+		[[gnu::target("avx2")]] inline __m256i broadcast(T value)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_set1_epi32(value);
+			else                          return _mm256_set1_epi64x(value);
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] inline __m256i cmpeq(__m256i a, __m256i b)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_cmpeq_epi32(a, b);
+			else                          return _mm256_cmpeq_epi64(a, b);
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] inline __m256i add(__m256i a, __m256i b)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_add_epi32(a, b);
+			else                          return _mm256_add_epi64(a, b);
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] inline __m256i min(__m256i a, __m256i b)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_min_epi32(a, b);
+			else                          return _mm256_blendv_epi8(a, b, _mm256_cmpgt_epi64(a, b));
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] inline __m256i max(__m256i a, __m256i b)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_max_epi32(a, b);
+			else                          return _mm256_blendv_epi8(b, a, _mm256_cmpgt_epi64(a, b));
+		}
+
+		[[gnu::target("avx2")]] inline __m256i load(void const* p)
+		{
+			return _mm256_loadu_si256(static_cast<__m256i const*>(p));
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] inline bool any_negative(__m256i v)
+		{
+			if constexpr (sizeof(T) == 4) return _mm256_movemask_ps(_mm256_castsi256_ps(v));
+			else                          return _mm256_movemask_pd(_mm256_castsi256_pd(v));
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] std::size_t find(T const* data, std::size_t n, T value)
+		{
+			constexpr std::size_t lanes = 32 / sizeof(T);
+			__m256i const needle = broadcast(value);
+			std::size_t i = 0;
+			for (; i + 2*lanes <= n; i += 2*lanes) {
+				__m256i const a = cmpeq<T>(load(data + i), needle);
+				__m256i const b = cmpeq<T>(load(data + i + lanes), needle);
+				if (!_mm256_testz_si256(_mm256_or_si256(a, b), _mm256_or_si256(a, b))) {
+					break;
+				}
+			}
+			return i + scalar::find(data + i, n - i, value);
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] bool equal(T const* lhs, T const* rhs, std::size_t n)
+		{
+			constexpr std::size_t lanes = 32 / sizeof(T);
+			std::size_t i = 0;
+			for (; i + lanes <= n; i += lanes) {
+				__m256i const diff = _mm256_xor_si256(load(lhs + i), load(rhs + i));
+				if (!_mm256_testz_si256(diff, diff)) {
+					return false;
+				}
+			}
+			return scalar::equal(lhs + i, rhs + i, n - i);
+		}
+
+		template<typename T, __m256i(*Combine)(__m256i, __m256i)>
+		[[gnu::target("avx2")]] T reduce(T const* data, std::size_t n, T init, T(*tail)(T, T))
+		{
+			constexpr std::size_t lanes = 32 / sizeof(T);
+			T result = init;
+			std::size_t i = 0;
+			if (n >= lanes) {
+				__m256i acc = load(data);
+				for (i = lanes; i + lanes <= n; i += lanes) {
+					acc = Combine(acc, load(data + i));
+				}
+				alignas(32) T partial[lanes];
+				_mm256_store_si256(reinterpret_cast<__m256i*>(partial), acc);
+				result = partial[0];
+				for (std::size_t j = 1; j < lanes; ++j) result = tail(result, partial[j]);
+			}
+			for (; i < n; ++i) result = tail(result, data[i]);
+			return result;
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] bool sum(T const* data, std::size_t n, T& result)
+		{
+			constexpr std::size_t lanes = 32 / sizeof(T);
+			if (n < lanes) return scalar::sum(data, n, result);
+
+			// Lane overflows when operands of same sign give sum of other sign
+			__m256i acc = load(data), overflow = _mm256_setzero_si256();
+			std::size_t i = lanes;
+			for (; i + lanes <= n; i += lanes) {
+				__m256i const x = load(data + i);
+				__m256i const s = add<T>(acc, x);
+				overflow = _mm256_or_si256(overflow, _mm256_andnot_si256(_mm256_xor_si256(acc, x), _mm256_xor_si256(acc, s)));
+				acc = s;
+			}
+			if (any_negative<T>(overflow)) return false;
+
+			alignas(32) T partial[lanes];
+			_mm256_store_si256(reinterpret_cast<__m256i*>(partial), acc);
+			return scalar::sum_lanes(partial, data + i, n - i, result);
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] T min(T const* data, std::size_t n)
+		{
+			return reduce<T, min<T>>(data, n, data[0], [](T a, T b) { return std::min(a, b); });
+		}
+
+		template<typename T>
+		[[gnu::target("avx2")]] T max(T const* data, std::size_t n)
+		{
+			return reduce<T, max<T>>(data, n, data[0], [](T a, T b) { return std::max(a, b); });
+		}
+	}
+#endif
+
+#ifdef COMPY_SIMD_NEON
+	namespace neon
+	{
+		template<typename T>
+		std::size_t find(T const* data, std::size_t n, T value)
+		{
+			std::size_t i = 0;
+			if constexpr (sizeof(T) == 4) {
+				int32x4_t const needle = vdupq_n_s32(value);
+				for (; i + 4 <= n; i += 4) {
+					if (vmaxvq_u32(vceqq_s32(vld1q_s32(data + i), needle))) break;
+				}
+			} else {
+				int64x2_t const needle = vdupq_n_s64(value);
+				for (; i + 2 <= n; i += 2) {
+					uint64x2_t const eq = vceqq_s64(vld1q_s64(data + i), needle);
+					if (vgetq_lane_u64(eq, 0) | vgetq_lane_u64(eq, 1)) break;
+				}
+			}
+			return i + scalar::find(data + i, n - i, value);
+		}
+
+		// Lane overflows when saturating sum differs from wrapping one
+		template<typename T>
+		bool sum(T const* data, std::size_t n, T& result)
+		{
+			std::size_t i = 0;
+			if constexpr (sizeof(T) == 4) {
+				int32x4_t acc = vdupq_n_s32(0), overflow = vdupq_n_s32(0);
+				for (; i + 4 <= n; i += 4) {
+					int32x4_t const x = vld1q_s32(data + i);
+					overflow = vorrq_s32(overflow, veorq_s32(vqaddq_s32(acc, x), vaddq_s32(acc, x)));
+					acc = vaddq_s32(acc, x);
+				}
+				if (vmaxvq_u32(vreinterpretq_u32_s32(overflow))) return false;
+				T partial[4];
+				vst1q_s32(partial, acc);
+				return scalar::sum_lanes(partial, data + i, n - i, result);
+			} else {
+				int64x2_t acc = vdupq_n_s64(0), overflow = vdupq_n_s64(0);
+				for (; i + 2 <= n; i += 2) {
+					int64x2_t const x = vld1q_s64(data + i);
+					overflow = vorrq_s64(overflow, veorq_s64(vqaddq_s64(acc, x), vaddq_s64(acc, x)));
+					acc = vaddq_s64(acc, x);
+				}
+				if (vmaxvq_u32(vreinterpretq_u32_s64(overflow))) return false;
+				T partial[2];
+				vst1q_s64(partial, acc);
+				return scalar::sum_lanes(partial, data + i, n - i, result);
+			}
+		}
+	}
+#endif
+
+	/// Index of first element equal to value, n if there is none
+	template<typename T>
+	std::size_t find(T const* data, std::size_t n, T value)
+	{
+		if constexpr (std::is_integral_v<T> && sizeof(T) >= 4) {
+#if defined(COMPY_SIMD_X86)
+			if (features().avx2) return avx2::find(data, n, value);
+#elif defined(COMPY_SIMD_NEON)
+			return neon::find(data, n, value);
+#endif
+		}
+		return scalar::find(data, n, value);
+	}
+
+	template<typename T>
+	bool equal(T const* lhs, T const* rhs, std::size_t n)
+	{
+		if constexpr (std::is_integral_v<T> && sizeof(T) >= 4) {
+#if defined(COMPY_SIMD_X86)
+			if (features().avx2) return avx2::equal(lhs, rhs, n);
+#endif
+			return std::memcmp(lhs, rhs, n * sizeof(T)) == 0;
+		}
+		return scalar::equal(lhs, rhs, n);
+	}
+
+	/// Sum of elements into result, false when it overflows T
+	template<typename T>
+	bool sum(T const* data, std::size_t n, T& result)
+	{
+		if constexpr (std::is_integral_v<T> && sizeof(T) >= 4) {
+#if defined(COMPY_SIMD_X86)
+			if (features().avx2) return avx2::sum(data, n, result);
+#elif defined(COMPY_SIMD_NEON)
+			return neon::sum(data, n, result);
+#endif
+		}
+		return scalar::sum(data, n, result);
+	}
+
+	/// Minimum of non-empty array
+	template<typename T>
+	T min(T const* data, std::size_t n)
+	{
+		if constexpr (std::is_integral_v<T> && sizeof(T) >= 4) {
+#if defined(COMPY_SIMD_X86)
+			if (features().avx2) return avx2::min(data, n);
+#endif
+		}
+		return scalar::min(data, n);
+	}
+
+	/// Maximum of non-empty array
+	template<typename T>
+	T max(T const* data, std::size_t n)
+	{
+		if constexpr (std::is_integral_v<T> && sizeof(T) >= 4) {
+#if defined(COMPY_SIMD_X86)
+			if (features().avx2) return avx2::max(data, n);
+#endif
+		}
+		return scalar::max(data, n);
+	}
+
+	/// Fills dst[0, count * n) with repetitions of src[0, n)
+	template<typename T>
+	void repeat(T const* src, std::size_t n, T* dst, std::size_t count)
+	{
+		if (n == 0 || count == 0) return;
+		if (n == 1) {
+			std::fill_n(dst, count, *src);
+			return;
+		}
+
+		// Copy source once, then double already filled prefix
+		std::size_t const total = n * count;
+		std::memcpy(dst, src, n * sizeof(T));
+		for (std::size_t filled = n; filled < total; filled *= 2) {
+			std::memcpy(dst + filled, dst, std::min(filled, total - filled) * sizeof(T));
+		}
+	}
+}
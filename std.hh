@@ -1,12 +1,35 @@
+#ifndef COMPY_STD_HH
+#define COMPY_STD_HH
+
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <cassert>
+#include <charconv>
 #include <cstdint>
-#include <iostream>
+#include <cstring>
+#include <initializer_list>
+#include <ostream>
+#include <new>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <tuple>
+#include <type_traits>
 #include <unordered_map>
 #include <variant>
 #include <vector>
 
+#include "allocation.hh"
+#include "hash_table.hh"
+#include "integer.hh"
+#include "io.hh"
+#include "output.hh"
+#include "parallel.hh"
+#include "profile.hh"
+#include "simd.hh"
+#include "str.hh"
+
 namespace python
 {
 	struct Error
@@ -14,18 +37,32 @@ namespace python
 		std::string_view type;
 		std::string message{};
 
-		Error operator()(std::string message)
-		{
-			return { type, std::move(message) };
-		}
+		void print(std::ostream& os) const;
+	};
+
+	/// Python exception class, calling it creates exception with message.
+	/// Immutable, so it can be shared by threads.
+	struct Exception_Type
+	{
+		std::string_view name;
 
-		void print(std::ostream& os) const
+		Error operator()(std::string message) const
 		{
-			os << type << ": " << message << std::endl;
+			return { name, std::move(message) };
 		}
 	};
 
-	Error type_error{"TypeError"};
+	inline constexpr Exception_Type type_error{"TypeError"};
+	inline constexpr Exception_Type value_error{"ValueError"};
+	inline constexpr Exception_Type overflow_error{"OverflowError"};
+	inline constexpr Exception_Type zero_division_error{"ZeroDivisionError"};
+	inline constexpr Exception_Type key_error{"KeyError"};
+	inline constexpr Exception_Type index_error{"IndexError"};
+	inline constexpr Exception_Type eof_error{"EOFError"};
+	inline constexpr Exception_Type memory_error{"MemoryError"};
+	inline constexpr Exception_Type os_error{"OSError"};
+	inline constexpr Exception_Type file_not_found_error{"FileNotFoundError"};
+	inline constexpr Exception_Type permission_error{"PermissionError"};
 }
 
 namespace python
@@ -38,21 +75,237 @@ namespace python
 
 	struct Value;
 	struct List;
+	struct Dict;
+	struct Set;
 
-	struct None {
+	inline constexpr struct None {
 		auto operator<=>(None const&) const = default;
 	} None;
 	using Bool = bool;
-	using Int = int;
-	using Str = std::string;
 
-	using Value_Variant = std::variant<struct None, Bool, Int, Str, List>;
+#ifdef COMPY_COMPACT_VALUE
+	/// Tagged 16 byte cell, alternative to std::variant.
+	/// Small trivially copyable alternatives are stored inline,
+	/// rest lives on the heap and is owned by the cell.
+	template<typename ...T>
+	struct Compact_Variant
+	{
+		template<typename U>
+		static constexpr bool is_inline = sizeof(U) <= sizeof(void*) && std::is_trivially_copyable_v<U>;
+
+		static constexpr std::size_t first(std::initializer_list<bool> matches)
+		{
+			std::size_t i = 0;
+			for (bool match : matches) {
+				if (match) break;
+				++i;
+			}
+			return i;
+		}
+
+		template<typename U>
+		static constexpr std::uint8_t index_of = first({ std::is_same_v<U, T>... });
+
+		template<std::size_t I>
+		using alternative = std::tuple_element_t<I, std::tuple<T...>>;
+
+		/// Alternative constructed from value of type U: exact match, then integer,
+		/// then first constructible (except bool, like std::variant)
+		template<typename U, typename D = std::decay_t<U>>
+		using target = std::conditional_t<(index_of<D> < sizeof...(T)), D,
+			std::conditional_t<std::is_integral_v<D> && !std::is_same_v<D, bool>, Int,
+				alternative<first({ (std::is_constructible_v<T, U> && !std::is_same_v<T, Bool>)... })>>>;
+
+		union {
+			alignas(void*) std::byte cell[sizeof(void*)];
+			void *heap;
+		};
+		std::uint8_t tag;
+
+		template<typename U>
+		requires (!std::is_base_of_v<Compact_Variant, std::decay_t<U>>)
+		Compact_Variant(U &&value)
+		{
+			emplace<target<U>>(std::forward<U>(value));
+		}
+
+		Compact_Variant(Compact_Variant const& other)
+		{
+			other.visit([this]<typename U>(U const& value) { emplace<U>(value); });
+		}
+
+		Compact_Variant(Compact_Variant &&other) noexcept
+			: tag(other.tag)
+		{
+			std::memcpy(cell, other.cell, sizeof(cell));
+			other.tag = 0;
+		}
+
+		Compact_Variant& operator=(Compact_Variant const& other)
+		{
+			if (this != &other) {
+				Compact_Variant copy(other);
+				*this = std::move(copy);
+			}
+			return *this;
+		}
+
+		Compact_Variant& operator=(Compact_Variant &&other) noexcept
+		{
+			if (this != &other) {
+				destroy();
+				tag = other.tag;
+				std::memcpy(cell, other.cell, sizeof(cell));
+				other.tag = 0;
+			}
+			return *this;
+		}
+
+		~Compact_Variant() { destroy(); }
+
+		std::size_t index() const { return tag; }
+
+		template<typename U>
+		bool holds() const { return tag == index_of<U>; }
+
+		template<typename U>
+		U* get_if() { return holds<U>() ? &unchecked<U>() : nullptr; }
+
+		template<typename U>
+		U const* get_if() const { return holds<U>() ? &unchecked<U>() : nullptr; }
+
+		template<typename U>
+		U& unchecked()
+		{
+			if constexpr (is_inline<U>) {
+				return *std::launder(reinterpret_cast<U*>(cell));
+			} else {
+				return *static_cast<U*>(heap);
+			}
+		}
+
+		template<typename U>
+		U const& unchecked() const
+		{
+			return const_cast<Compact_Variant*>(this)->unchecked<U>();
+		}
+
+		template<typename F>
+		decltype(auto) visit(F &&f) const
+		{
+			using R = decltype(f(std::declval<alternative<0> const&>()));
+			static constexpr R(*table[])(F&, Compact_Variant const&) = {
+				[](F& f, Compact_Variant const& self) -> R { return f(self.unchecked<T>()); }...
+			};
+			return table[tag](f, *this);
+		}
+
+	private:
+		template<typename U, typename ...Args>
+		void emplace(Args &&...args)
+		{
+			tag = index_of<U>;
+			if constexpr (is_inline<U>) {
+				new (cell) U(std::forward<Args>(args)...);
+			} else {
+				heap = new U(std::forward<Args>(args)...);
+			}
+		}
+
+		void destroy()
+		{
+			visit([this]<typename U>(U const&) {
+				if constexpr (!is_inline<U>) {
+					delete static_cast<U*>(heap);
+				}
+			});
+			tag = 0;
+		}
+	};
+
+	using Value_Variant = Compact_Variant<struct None, Bool, Int, BigInt, Str, List, Dict, Set>;
+#else
+	using Value_Variant = std::variant<struct None, Bool, Int, BigInt, Str, List, Dict, Set>;
+#endif
+
+	// Access to alternatives of value, independent of it's representation
+	template<typename T>
+	bool holds(Value_Variant const& value)
+	{
+#ifdef COMPY_COMPACT_VALUE
+		return value.template holds<T>();
+#else
+		return std::holds_alternative<T>(value);
+#endif
+	}
+
+	template<typename T>
+	T const* get_if(Value_Variant const* value)
+	{
+#ifdef COMPY_COMPACT_VALUE
+		return value->template get_if<T>();
+#else
+		return std::get_if<T>(value);
+#endif
+	}
+
+	template<typename T>
+	T* get_if(Value_Variant* value)
+	{
+#ifdef COMPY_COMPACT_VALUE
+		return value->template get_if<T>();
+#else
+		return std::get_if<T>(value);
+#endif
+	}
+
+	template<typename F>
+	decltype(auto) visit(F &&f, Value_Variant const& value)
+	{
+#ifdef COMPY_COMPACT_VALUE
+		return value.visit(std::forward<F>(f));
+#else
+		return std::visit(std::forward<F>(f), value);
+#endif
+	}
+
+	template<typename F>
+	decltype(auto) visit(F &&f, Value_Variant const& lhs, Value_Variant const& rhs)
+	{
+#ifdef COMPY_COMPACT_VALUE
+		return lhs.visit([&](auto const& lhs) {
+			return rhs.visit([&](auto const& rhs) { return f(lhs, rhs); });
+		});
+#else
+		return std::visit(std::forward<F>(f), lhs, rhs);
+#endif
+	}
+
+	[[noreturn]] void throw_memory_error();
+
+	/// Position of element at index, negative one counts from the end
+	inline std::size_t list_index(Int i, std::size_t size)
+	{
+		auto const n = Int(size);
+		if (i < 0) i += n;
+		if (i < 0 || i >= n) [[unlikely]] throw_index_error("list index out of range");
+		return std::size_t(i);
+	}
+
+	/// Times list of given size is repeated by `l * n`, raises MemoryError when result can't fit
+	inline std::size_t repeat_count(std::size_t size, Int n, std::size_t max_size)
+	{
+		if (n <= 0 || size == 0) return 0;
+		if (std::uint64_t(n) > max_size / size) [[unlikely]] throw_memory_error();
+		return std::size_t(n);
+	}
 
 	struct List : std::vector<Value>
 	{
 		template<typename ...T>
 		static List init(T&& ...args)
 		{
+			allocation::Scope scope(allocation::Category::List);
 			if constexpr (0 == sizeof...(args)) {
 				return List{};
 			} else {
@@ -62,39 +315,144 @@ namespace python
 
 		auto& parent() { return *static_cast<std::vector<Value>*>(this); }
 
-		Value& operator[](int i)
+		Value& operator[](Int i)
+		{
+			return parent()[list_index(i, size())];
+		}
+
+		Value const& operator[](Int i) const
 		{
-			assert(size_t(std::abs(i)) < size());
-			return i >= 0 ? parent()[i] : parent()[size() + i];
+			return std::vector<Value>::operator[](list_index(i, size()));
 		}
 
 		List& operator+=(List &&other)
 		{
+			allocation::Scope scope(allocation::Category::List);
 			std::move(other.begin(), other.end(), std::back_inserter(*this));
 			return *this;
 		}
 
 		void append(Value &&value)
 		{
+			allocation::Scope scope(allocation::Category::List);
 			push_back(std::move(value));
 		}
+
+		/// Copy of elements selected by slice
+		List slice(Slice const& bounds) const;
+	};
+
+	struct Dict_Entry;
+	struct Set_Entry;
+
+	struct Key_Of { auto const& operator()(auto const& entry) const { return entry.key; } };
+	struct Value_Of { auto const& operator()(auto const& entry) const { return entry.value; } };
+	struct Entry_Of { auto const& operator()(auto const& entry) const { return entry; } };
+
+	/// Python's dict. Members are defined after Value, which they store.
+	/// Keys of type str, int, bool or Value are looked up without being
+	/// converted into Value, which is only made when key is inserted.
+	struct Dict : Hash_Table<Dict_Entry>
+	{
+		template<typename ...T>
+		static Dict init(T&& ...keys_and_values);
+
+		Value* find(auto const& key);
+		Value const* find(auto const& key) const;
+
+		/// Value of key, raises KeyError when it's missing
+		Value& at(auto const& key);
+		Value const& at(auto const& key) const;
+
+		void set(auto&& key, Value value);
+
+		/// Raises KeyError when key is missing
+		void erase(auto const& key);
+
+		Value get(auto const& key) const;
+		Value get(auto const& key, Value otherwise) const;
+		Value pop(auto const& key);
+		Value pop(auto const& key, Value otherwise);
+		Value& setdefault(auto&& key);
+		Value& setdefault(auto&& key, Value value);
+		void update(Dict const& other);
+
+		Live_Entries<Dict_Entry, Key_Of> keys() const;
+		Live_Entries<Dict_Entry, Value_Of> values() const;
+
+		/// Entries with key and value members
+		Live_Entries<Dict_Entry, Entry_Of> items() const;
+
+		Live_Entries<Dict_Entry, Key_Of>::Iterator begin() const;
+		Live_Entries<Dict_Entry, Key_Of>::Iterator end() const;
+
+		/// Equal keys map to equal values, regardless of order
+		bool operator==(Dict const& other) const;
+	};
+
+	/// Python's set, elements kept in insertion order and looked up like keys of dict
+	struct Set : Hash_Table<Set_Entry>
+	{
+		template<typename ...T>
+		static Set init(T&& ...elements);
+
+		bool contains(auto const& element) const;
+		void add(auto&& element);
+		void discard(auto const& element);
+
+		/// Raises KeyError when element is missing
+		void remove(auto const& element);
+
+		Live_Entries<Set_Entry, Key_Of>::Iterator begin() const;
+		Live_Entries<Set_Entry, Key_Of>::Iterator end() const;
+
+		bool operator==(Set const& other) const;
 	};
 
+	// Operators on values check the common case of two Int first, and only
+	// when it misses dispatch on types of both operands in runtime.cc
+	namespace value
+	{
+		inline Value add(Value const& lhs, Value const& rhs);
+		inline Value sub(Value const& lhs, Value const& rhs);
+		inline Value mul(Value const& lhs, Value const& rhs);
+		inline Value mod(Value const& lhs, Value const& rhs);
+		inline Value neg(Value const& operand);
+
+		/// Three way comparison, raises TypeError when values are not ordered
+		inline int compare(Value const& lhs, Value const& rhs, char const* op);
+	}
+
 	struct Value : Value_Variant
 	{
 		Value() : Value_Variant{None} {}
 
 		template<typename T>
+		requires (!std::is_same_v<std::decay_t<T>, Integer>)
 		Value(T &&val) : Value_Variant(std::forward<T>(val)) {}
 
+		/// Only integers that don't fit into Int are stored as BigInt
+		Value(Integer const& i)
+			: Value_Variant(i.is_small() ? Value_Variant(i.small) : Value_Variant(*i.big))
+		{
+		}
+
 		bool is_none() const
 		{
-			return std::holds_alternative<struct None>(*this);
+			return python::holds<struct None>(*this);
+		}
+
+		Value& operator[](Int i)
+		{
+			if (List* p = python::get_if<List>(this); p) {
+				return (*p)[i];
+			}
+			throw type_error("Subscript is only allowed for list types");
 		}
 
-		Value& operator[](int i)
+		Value const& operator[](Int i) const
 		{
-			if (List* p = std::get_if<List>(this); p) {
+			if (List const* p = python::get_if<List>(this); p) {
 				return (*p)[i];
 			}
 			throw type_error("Subscript is only allowed for list types");
@@ -102,12 +460,15 @@ namespace python
 
 		bool coarce_bool() const
 		{
-			return std::visit(overloaded{
+			return python::visit(overloaded{
 				[](struct None) { return false; },
 				[](Bool b) { return b; },
 				[](Int const& i) { return i != 0; },
+				[](BigInt const& i) { return !i.is_zero(); },
 				[](Str const& s) { return not s.empty(); },
-				[](List const& l) { return not l.empty(); }
+				[](List const& l) { return not l.empty(); },
+				[](Dict const& d) { return d.size() != 0; },
+				[](Set const& s) { return s.size() != 0; }
 			}, *static_cast<Value_Variant const*>(this));
 		}
 
@@ -116,235 +477,1314 @@ namespace python
 			return coarce_bool();
 		}
 
-		bool operator==(Value const& rhs) const
+		bool operator==(Value const& rhs) const;
+
+		// Hidden friends, so other operand is converted to Value only when
+		// one of them already is
+		friend Value operator+(Value const& lhs, Value const& rhs) { return value::add(lhs, rhs); }
+		friend Value operator-(Value const& lhs, Value const& rhs) { return value::sub(lhs, rhs); }
+		friend Value operator*(Value const& lhs, Value const& rhs) { return value::mul(lhs, rhs); }
+		friend Value operator%(Value const& lhs, Value const& rhs) { return value::mod(lhs, rhs); }
+		friend Value operator-(Value const& operand) { return value::neg(operand); }
+
+		friend bool operator<(Value const& lhs, Value const& rhs)  { return value::compare(lhs, rhs, "<") < 0; }
+		friend bool operator<=(Value const& lhs, Value const& rhs) { return value::compare(lhs, rhs, "<=") <= 0; }
+		friend bool operator>(Value const& lhs, Value const& rhs)  { return value::compare(lhs, rhs, ">") > 0; }
+		friend bool operator>=(Value const& lhs, Value const& rhs) { return value::compare(lhs, rhs, ">=") >= 0; }
+
+		/// Also makes List, a vector of values, comparable
+		friend std::strong_ordering operator<=>(Value const& lhs, Value const& rhs)
 		{
-			return std::visit(overloaded{
-				[](struct python::None, struct python::None) { return true; },
-				[](Bool lhs, Bool rhs) { return lhs == rhs; },
-				[](Int const& lhs, Int const& rhs) { return lhs == rhs; },
-				[](Str const& lhs, Str const& rhs) { return lhs == rhs; },
-				[](List const& lhs, List const& rhs) { return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()); },
-				[](auto const&, auto const&) { return false; }
-			}, static_cast<Value_Variant const&>(*this), static_cast<Value_Variant const&>(rhs));
+			return value::compare(lhs, rhs, "<") <=> 0;
 		}
+
+		Value& operator+=(Value const& rhs) { return *this = *this + rhs; }
+		Value& operator-=(Value const& rhs) { return *this = *this - rhs; }
+		Value& operator*=(Value const& rhs) { return *this = *this * rhs; }
+		Value& operator%=(Value const& rhs) { return *this = *this % rhs; }
 	};
 
-	struct Keyword_Arguments
+	namespace value
 	{
-		std::unordered_map<std::string, Value> dict;
+		/// Number of operations that missed Int fast path,
+		/// reported at exit when COMPY_SLOW_PATHS environment variable is set
+		struct Slow_Path_Counters
+		{
+			std::atomic<std::uint64_t> add, sub, mul, mod, neg, compare, equal;
+		};
+
+		extern Slow_Path_Counters slow_paths;
+
+		void report_slow_paths(std::ostream& os);
+
+		Value add_slow(Value const& lhs, Value const& rhs);
+		Value sub_slow(Value const& lhs, Value const& rhs);
+		Value mul_slow(Value const& lhs, Value const& rhs);
+		Value mod_slow(Value const& lhs, Value const& rhs);
+		Value neg_slow(Value const& operand);
+
+		int compare_slow(Value const& lhs, Value const& rhs, char const* op);
+
+		bool equal_slow(Value const& lhs, Value const& rhs);
 
-		inline Keyword_Arguments& append(std::string const& key, Value value)
+		inline bool both_int(Value const& lhs, Value const& rhs)
 		{
-			dict[key] = std::move(value);
-			return *this;
+			return holds<Int>(lhs) && holds<Int>(rhs);
 		}
-	};
 
-	template<typename T>
-	T assert_type(Value const& value, auto const& message)
-	{
-		if (std::holds_alternative<T>(value)) {
-			return std::get<T>(value);
+		inline Int int_of(Value const& value)
+		{
+			return *get_if<Int>(&value);
 		}
 
-		throw type_error(message);
-	}
+		inline Value add(Value const& lhs, Value const& rhs)
+		{
+			if (Int result; both_int(lhs, rhs) && !__builtin_add_overflow(int_of(lhs), int_of(rhs), &result)) [[likely]] {
+				return result;
+			}
+			return add_slow(lhs, rhs);
+		}
 
-	template<typename T>
-	T type_or_none_default(Value const& value, T def, auto const& message)
-	{
-		if (std::holds_alternative<T>(value)) {
-			return std::get<T>(value);
+		inline Value sub(Value const& lhs, Value const& rhs)
+		{
+			if (Int result; both_int(lhs, rhs) && !__builtin_sub_overflow(int_of(lhs), int_of(rhs), &result)) [[likely]] {
+				return result;
+			}
+			return sub_slow(lhs, rhs);
 		}
-		if (std::holds_alternative<struct None>(value)) {
-			return def;
+
+		inline Value mul(Value const& lhs, Value const& rhs)
+		{
+			if (Int result; both_int(lhs, rhs) && !__builtin_mul_overflow(int_of(lhs), int_of(rhs), &result)) [[likely]] {
+				return result;
+			}
+			return mul_slow(lhs, rhs);
 		}
 
-		throw type_error(message);
+		inline Value mod(Value const& lhs, Value const& rhs)
+		{
+			if (both_int(lhs, rhs) && int_of(rhs) > 0) [[likely]] {
+				Int const result = int_of(lhs) % int_of(rhs);
+				return result < 0 ? result + int_of(rhs) : result;
+			}
+			return mod_slow(lhs, rhs);
+		}
+
+		inline Value neg(Value const& operand)
+		{
+			if (Int result; holds<Int>(operand) && !__builtin_sub_overflow(Int(0), int_of(operand), &result)) [[likely]] {
+				return result;
+			}
+			return neg_slow(operand);
+		}
+
+		inline int compare(Value const& lhs, Value const& rhs, char const* op)
+		{
+			if (both_int(lhs, rhs)) [[likely]] {
+				return (int_of(lhs) > int_of(rhs)) - (int_of(lhs) < int_of(rhs));
+			}
+			return compare_slow(lhs, rhs, op);
+		}
 	}
 
-	template<typename T>
-	T type_or_none(Value const& value, auto const& message)
+	inline bool Value::operator==(Value const& rhs) const
 	{
-		return type_or_none_default<T>(value, {}, message);
+		if (value::both_int(*this, rhs)) [[likely]] {
+			return value::int_of(*this) == value::int_of(rhs);
+		}
+		return value::equal_slow(*this, rhs);
 	}
-}
 
+	namespace value
+	{
+		/// Finalizer of MurmurHash3, spreads entropy of integers into all bits
+		inline std::size_t mix(std::uint64_t x)
+		{
+			x ^= x >> 33;
+			x *= 0xff51afd7ed558ccd;
+			x ^= x >> 33;
+			x *= 0xc4ceb9fe1a85ec53;
+			return x ^ (x >> 33);
+		}
 
-using list = python::List;
-using any = python::Value;
+		/// Raises TypeError for unhashable values
+		std::size_t hash_slow(Value const& value);
 
-list operator*(list l, int n)
-{
-	list result;
+		/// Consistent with equality, so equal numbers like 1 and True are the same key
+		inline std::size_t hash(Value const& value)
+		{
+			if (holds<Int>(value)) [[likely]] return mix(int_of(value));
+			if (auto s = get_if<Str>(&value)) return std::hash<std::string_view>{}(*s);
+			return hash_slow(value);
+		}
 
-	while (n-- > 0) {
-		result.insert(result.end(), l.begin(), l.end());
-	}
+		inline std::size_t hash(std::string_view s) { return std::hash<std::string_view>{}(s); }
+		inline std::size_t hash(Int i) { return mix(i); }
 
-	return result;
-}
+		/// Key of dict or element of set in form hashed and compared like Value holding it
+		inline std::string_view key(Str const& s) { return s; }
+		inline std::string_view key(std::string_view s) { return s; }
+		inline std::string_view key(char const* s) { return s; }
+		inline Int key(std::integral auto i) { return i; }
+		inline Value key(Integer const& i) { return i; }
+		inline Value const& key(Value const& v) { return v; }
 
-list operator+(list lhs, list rhs)
-{
-	return lhs += std::move(rhs);
-}
+		/// Key as Value stored by dict or set, views of strings are copied
+		inline Value stored(auto&& key) { return Value(std::forward<decltype(key)>(key)); }
+		inline Value stored(std::string_view key) { return Str(key); }
 
-bool operator==(any const& lhs, list const& rhs)
-{
-	return std::visit(python::overloaded{
-		[&](list const& lhs) { return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end()); },
-		[](auto const&) { return false; }
-	}, static_cast<python::Value_Variant const&>(lhs));
-}
+		inline bool same_key(Value const& stored, std::string_view key)
+		{
+			auto s = get_if<Str>(&stored);
+			return s && *s == key;
+		}
 
-std::ostream& operator<<(std::ostream& os, any const& val);
+		inline bool same_key(Value const& stored, Int key)
+		{
+			return holds<Int>(stored) ? int_of(stored) == key : stored == Value(key);
+		}
 
-std::ostream& operator<<(std::ostream& os, list const& p)
-{
-	os << '[';
+		inline bool same_key(Value const& stored, Value const& key) { return stored == key; }
 
-	for (auto it = p.begin(); it != p.end(); ++it) {
-		os << *it;
-		if (std::next(it) != p.end())
-			os << ", ";
+		/// Predicate for Hash_Table::find() matching entries with given key
+		inline auto key_equal(auto const& key)
+		{
+			return [&key](Value const& stored) { return same_key(stored, key); };
+		}
 	}
 
-	return os << ']';
-}
+	[[noreturn]] void throw_key_error(Value const& key);
 
-std::ostream& operator<<(std::ostream& os, any const& val)
-{
-	if (std::holds_alternative<struct python::None>(val)) {
-		return os << "None";
+	struct Dict_Entry
+	{
+		std::size_t hash = 0;
+		Value key, value;
+		bool removed = false;
+	};
+
+	struct Set_Entry
+	{
+		std::size_t hash = 0;
+		Value key;
+		bool removed = false;
+	};
+
+	template<typename ...T>
+	Dict Dict::init(T&& ...keys_and_values)
+	{
+		static_assert(sizeof...(T) % 2 == 0, "Keys and values come in pairs");
+		Dict dict;
+		Value pairs[] = { Value(), Value(std::forward<T>(keys_and_values))... };
+		for (std::size_t i = 1; i < std::size(pairs); i += 2) {
+			dict.set(std::move(pairs[i]), std::move(pairs[i + 1]));
+		}
+		return dict;
 	}
 
-	if (auto p = std::get_if<bool>(&val); p) {
-		return os << (*p ? "True" : "False");
+	inline Value* Dict::find(auto const& key)
+	{
+		auto const& k = value::key(key);
+		auto entry = Hash_Table::find(value::hash(k), value::key_equal(k));
+		return entry ? &entry->value : nullptr;
 	}
 
-	if (auto p = std::get_if<int>(&val); p) {
-		return os << *p;
+	inline Value const* Dict::find(auto const& key) const
+	{
+		return const_cast<Dict*>(this)->find(key);
 	}
 
-	if (auto p = std::get_if<list>(&val); p) {
-		return os << *p;
+	inline Value& Dict::at(auto const& key)
+	{
+		if (auto value = find(key)) [[likely]] return *value;
+		throw_key_error(Value(key));
 	}
 
-	assert(false && "printing is not supported yet for this type");
-}
+	inline Value const& Dict::at(auto const& key) const
+	{
+		return const_cast<Dict*>(this)->at(key);
+	}
 
-std::string operator"" _str(char const* str, unsigned long length)
-{
-	return { str, length };
-}
+	inline void Dict::set(auto&& key, Value value)
+	{
+		setdefault(std::forward<decltype(key)>(key), Value()) = std::move(value);
+	}
 
-auto str(auto v)
-{
-	return std::to_string(v);
-}
+	inline void Dict::erase(auto const& key)
+	{
+		auto const& k = value::key(key);
+		if (!Hash_Table::erase(value::hash(k), value::key_equal(k))) throw_key_error(Value(key));
+	}
 
-namespace python
-{
-	struct Printer
+	inline Value Dict::get(auto const& key) const
 	{
-		std::string separator = " ";
-		std::string end = "\n";
-		bool flush = false;
+		auto value = find(key);
+		return value ? *value : Value();
+	}
 
-		void print(auto const& arg0, auto const& ...args)
-		{
-			std::cout << arg0;
-			if constexpr (sizeof...(args) > 0) {
-				((std::cout << separator) << ... << args);
-			}
-			print();
-		}
+	inline Value Dict::get(auto const& key, Value otherwise) const
+	{
+		auto value = find(key);
+		return value ? *value : otherwise;
+	}
 
-		void print()
-		{
-			std::cout << end;
-			if (flush) {
-				std::cout << std::flush;
-			}
-		}
-	};
-}
+	inline Value Dict::pop(auto const& key)
+	{
+		Value result = std::move(at(key));
+		erase(key);
+		return result;
+	}
 
-void print(python::Keyword_Arguments kw, auto const& ...args)
-{
-	python::Printer printer;
-	if (kw.dict.contains("sep") && not kw.dict["sep"].is_none()) {
-		printer.separator = python::assert_type<std::string>(kw.dict["sep"], "sep must be None or a string");
+	inline Value Dict::pop(auto const& key, Value otherwise)
+	{
+		auto value = find(key);
+		if (!value) return otherwise;
+		Value result = std::move(*value);
+		erase(key);
+		return result;
 	}
 
-	if (kw.dict.contains("end") && not kw.dict["end"].is_none()) {
-		printer.end = python::type_or_none<std::string>(kw.dict["end"], "end must be None or a string");
+	inline Value& Dict::setdefault(auto&& key)
+	{
+		return setdefault(std::forward<decltype(key)>(key), Value());
 	}
 
-	if (kw.dict.contains("flush") && not kw.dict["flush"].is_none()) {
-		printer.flush = python::assert_type<bool>(kw.dict["flush"], "flush must be None or a bool");
+	inline Value& Dict::setdefault(auto&& key, Value value)
+	{
+		auto const& k = value::key(key);
+		auto const hash = value::hash(k);
+		if (auto entry = Hash_Table::find(hash, value::key_equal(k))) return entry->value;
+		return insert({ hash, value::stored(std::forward<decltype(key)>(key)), std::move(value) }).value;
 	}
 
-	assert(!kw.dict.contains("file") && "File specification for print() function is not implemented yet");
-	printer.print(args...);
-}
+	inline void Dict::update(Dict const& other)
+	{
+		for (auto const& entry : other.items()) set(entry.key, entry.value);
+	}
 
-void print(auto const& ...args)
-{
-	python::Printer{}.print(args...);
-}
+	inline Live_Entries<Dict_Entry, Key_Of> Dict::keys() const
+	{
+		return { entries.data(), entries.data() + entries.size() };
+	}
 
-void compy_main();
+	inline Live_Entries<Dict_Entry, Value_Of> Dict::values() const
+	{
+		return { entries.data(), entries.data() + entries.size() };
+	}
 
-int main()
-{
-	try {
-		compy_main();
-	} catch (python::Error const& error) {
-		error.print(std::cerr);
-		return 1;
+	inline Live_Entries<Dict_Entry, Entry_Of> Dict::items() const
+	{
+		return { entries.data(), entries.data() + entries.size() };
 	}
-}
+
+	inline Live_Entries<Dict_Entry, Key_Of>::Iterator Dict::begin() const { return keys().begin(); }
+	inline Live_Entries<Dict_Entry, Key_Of>::Iterator Dict::end() const { return keys().end(); }
+
+	inline bool Dict::operator==(Dict const& other) const
+	{
+		if (size() != other.size()) return false;
+		for (auto const& entry : items()) {
+			auto value = other.find(entry.key);
+			if (!value || !(*value == entry.value)) return false;
+		}
+		return true;
+	}
+
+	template<typename ...T>
+	Set Set::init(T&& ...elements)
+	{
+		Set set;
+		(set.add(std::forward<T>(elements)), ...);
+		return set;
+	}
+
+	inline bool Set::contains(auto const& element) const
+	{
+		auto const& k = value::key(element);
+		return find(value::hash(k), value::key_equal(k)) != nullptr;
+	}
+
+	inline void Set::add(auto&& element)
+	{
+		auto const& k = value::key(element);
+		auto const hash = value::hash(k);
+		if (!find(hash, value::key_equal(k))) insert({ hash, value::stored(std::forward<decltype(element)>(element)) });
+	}
+
+	inline void Set::discard(auto const& element)
+	{
+		auto const& k = value::key(element);
+		erase(value::hash(k), value::key_equal(k));
+	}
+
+	inline void Set::remove(auto const& element)
+	{
+		auto const& k = value::key(element);
+		if (!erase(value::hash(k), value::key_equal(k))) throw_key_error(Value(element));
+	}
+
+	inline Live_Entries<Set_Entry, Key_Of>::Iterator Set::begin() const
+	{
+		return Live_Entries<Set_Entry, Key_Of>{ entries.data(), entries.data() + entries.size() }.begin();
+	}
+
+	inline Live_Entries<Set_Entry, Key_Of>::Iterator Set::end() const
+	{
+		return Live_Entries<Set_Entry, Key_Of>{ entries.data(), entries.data() + entries.size() }.end();
+	}
+
+	inline bool Set::operator==(Set const& other) const
+	{
+		if (size() != other.size()) return false;
+		for (auto const& element : *this) {
+			if (!other.contains(element)) return false;
+		}
+		return true;
+	}
+
+	/// Keyword arguments of a call, stored inline.
+	/// Names are string literals emitted by the transpiler.
+	struct Keyword_Arguments
+	{
+		static constexpr std::size_t capacity = 8;
+
+		std::array<std::string_view, capacity> names{};
+		std::array<Value, capacity> values{};
+		std::size_t count = 0;
+
+		inline Keyword_Arguments& append(std::string_view name, Value value)
+		{
+			assert(count < capacity && "Too many keyword arguments");
+			allocation::Scope scope(allocation::Category::Keyword_Arguments);
+			names[count] = name;
+			values[count++] = std::move(value);
+			return *this;
+		}
+
+		/// Value of argument with given name, if it was passed and it's not None
+		inline Value const* find(std::string_view name) const
+		{
+			for (std::size_t i = 0; i < count; ++i) {
+				if (names[i] == name) {
+					return values[i].is_none() ? nullptr : &values[i];
+				}
+			}
+			return nullptr;
+		}
+	};
+
+	template<typename T>
+	T const& assert_type(Value const& value, auto const& message)
+	{
+		if (auto p = get_if<T>(&value); p) {
+			return *p;
+		}
+
+		throw type_error(message);
+	}
+
+	template<typename T>
+	T type_or_none_default(Value const& value, T def, auto const& message)
+	{
+		if (auto p = get_if<T>(&value); p) {
+			return *p;
+		}
+		if (holds<struct None>(value)) {
+			return def;
+		}
+
+		throw type_error(message);
+	}
+
+	template<typename T>
+	T type_or_none(Value const& value, auto const& message)
+	{
+		return type_or_none_default<T>(value, {}, message);
+	}
+
+	/// View of string value, or default when it's None
+	inline std::string_view str_or_none(Value const& value, std::string_view def, auto const& message)
+	{
+		if (auto p = get_if<Str>(&value); p) {
+			return *p;
+		}
+		if (holds<struct None>(value)) {
+			return def;
+		}
+
+		throw type_error(message);
+	}
+
+	/// Memory for temporaries that don't outlive the block they're created in.
+	/// Small amounts are served from the stack, rest from the heap,
+	/// and everything is released at once when the block ends.
+	struct Arena : std::pmr::monotonic_buffer_resource
+	{
+		alignas(std::max_align_t) std::byte buffer[1024];
+
+		Arena() : std::pmr::monotonic_buffer_resource(buffer, sizeof(buffer)) {}
+	};
+
+	/// Element of typed list of booleans,
+	/// since elements of std::vector<bool> can't be referenced
+	struct Boolean
+	{
+		Bool value = false;
+
+		Boolean(Bool value = false) : value(value) {}
+		operator Bool&() { return value; }
+		operator Bool() const { return value; }
+	};
+
+	/// List with all elements of the same type T, stored contiguously.
+	/// Used when transpiler proves that list is homogeneous, and converts
+	/// to generic List when it's used in place that may hold any value.
+	/// Temporaries may be allocated from Arena.
+	/// Integers are read as Integer and stored as Int, until list is assigned
+	/// value that doesn't fit, then all elements move into promoted.
+	template<typename T>
+	struct Typed_List : std::pmr::vector<std::conditional_t<std::is_same_v<T, Bool>, Boolean, T>>
+	{
+		using Element = std::conditional_t<std::is_same_v<T, Bool>, Boolean, T>;
+		using Vector = std::pmr::vector<Element>;
+		using Vector::Vector;
+
+		static constexpr bool integers = std::is_same_v<T, Int>;
+
+		/// Elements of list of integers after one of them didn't fit into Int,
+		/// empty while they're stored in vector
+		[[no_unique_address]] std::conditional_t<integers, std::vector<Integer>, std::tuple<>> promoted;
+
+		/// Reference to item of list of integers
+		struct Item
+		{
+			Typed_List& list;
+			std::size_t index;
+
+			operator Integer() const { return list.item(index); }
+
+			Item& operator=(Integer const& value) { list.assign(index, value); return *this; }
+			Item& operator=(Item const& other) { return *this = Integer(other); }
+			Item& operator+=(Integer const& value) { return *this = Integer(*this) + value; }
+			Item& operator-=(Integer const& value) { return *this = Integer(*this) - value; }
+			Item& operator*=(Integer const& value) { return *this = Integer(*this) * value; }
+			Item& operator%=(Integer const& value) { return *this = Integer(*this) % value; }
+		};
+
+		/// Iterator over items of list of integers
+		struct Integers
+		{
+			using iterator_category = std::input_iterator_tag;
+			using value_type = Integer;
+			using difference_type = std::ptrdiff_t;
+			using reference = Integer;
+
+			Typed_List const* list;
+			std::size_t index;
+
+			Integer operator*() const { return list->item(index); }
+			Integers& operator++() { ++index; return *this; }
+			Integers operator++(int) { auto copy = *this; ++index; return copy; }
+			bool operator==(Integers const&) const = default;
+		};
+
+		Typed_List() = default;
+
+		template<typename ...Args>
+		static Typed_List init(std::pmr::memory_resource *resource, Args&& ...args)
+		{
+			Typed_List result(resource);
+			result.reserve(sizeof...(args));
+			(result.append(std::forward<Args>(args)), ...);
+			return result;
+		}
+
+		/// Conversion from generic list, which elements must be of type T
+		Typed_List(List const& list)
+		{
+			this->reserve(list.size());
+			for (auto const& element : list) {
+				if constexpr (integers) {
+					if (auto big = get_if<BigInt>(&element); big) {
+						append(Integer(*big));
+						continue;
+					}
+				}
+				append(assert_type<T>(element, "list element has unexpected type"));
+			}
+		}
+
+		/// Promotion to generic list
+		operator List() const
+		{
+			List result;
+			result.reserve(size());
+			for (auto const& element : *this) {
+				if constexpr (integers) result.emplace_back(element);
+				else                    result.emplace_back(T(element));
+			}
+			return result;
+		}
+
+		bool is_promoted() const
+		{
+			if constexpr (integers) return !promoted.empty();
+			else                    return false;
+		}
+
+		std::size_t size() const
+		{
+			if constexpr (integers) {
+				if (is_promoted()) [[unlikely]] return promoted.size();
+			}
+			return Vector::size();
+		}
+
+		bool empty() const { return size() == 0; }
+
+		auto begin()
+		{
+			if constexpr (integers) return Integers{this, 0};
+			else                    return Vector::begin();
+		}
+
+		auto end()
+		{
+			if constexpr (integers) return Integers{this, size()};
+			else                    return Vector::end();
+		}
+
+		auto begin() const
+		{
+			if constexpr (integers) return Integers{this, 0};
+			else                    return Vector::begin();
+		}
+
+		auto end() const
+		{
+			if constexpr (integers) return Integers{this, size()};
+			else                    return Vector::end();
+		}
+
+		Integer item(std::size_t i) const requires integers
+		{
+			if (is_promoted()) [[unlikely]] return promoted[i];
+			return Vector::operator[](i);
+		}
+
+		void assign(std::size_t i, Integer const& value) requires integers
+		{
+			if (!is_promoted() && value.is_small()) [[likely]] {
+				Vector::operator[](i) = value.small;
+			} else {
+				promote();
+				promoted[i] = value;
+			}
+		}
+
+		/// Moves elements into promoted. Items of lists shared by iterations
+		/// of parallel loop are accessed concurrently, so they can't move.
+		void promote() requires integers
+		{
+			if (is_promoted()) return;
+			if (parallel::inside_loop()) {
+				throw overflow_error("integer assigned to list in parallel loop doesn't fit into 64 bits");
+			}
+			promoted.assign(Vector::begin(), Vector::end());
+			Vector::clear();
+		}
+
+		auto operator[](Int i) -> std::conditional_t<integers, Item, Element&>
+		{
+			std::size_t const index = list_index(i, size());
+			if constexpr (integers) return Item{*this, index};
+			else                    return Vector::operator[](index);
+		}
+
+		auto operator[](Int i) const -> std::conditional_t<integers, Integer, Element const&>
+		{
+			std::size_t const index = list_index(i, size());
+			if constexpr (integers) return item(index);
+			else                    return Vector::operator[](index);
+		}
+
+		Typed_List& operator+=(Typed_List const& other)
+		{
+			if constexpr (integers) {
+				if (is_promoted() || other.is_promoted()) [[unlikely]] {
+					std::vector<Integer> const items(other.begin(), other.end());
+					promote();
+					promoted.insert(promoted.end(), items.begin(), items.end());
+					return *this;
+				}
+			}
+			this->insert(Vector::end(), other.Vector::begin(), other.Vector::end());
+			return *this;
+		}
+
+		void append(Integer const& value) requires integers
+		{
+			if (!is_promoted() && value.is_small()) [[likely]] {
+				this->push_back(value.small);
+			} else {
+				promote();
+				promoted.push_back(value);
+			}
+		}
+
+		void append(T value) requires (!integers)
+		{
+			this->push_back(std::move(value));
+		}
+
+		/// Copy of elements selected by slice, sharing allocator of this list
+		Typed_List slice(Slice const& bounds) const
+		{
+			auto const [start, step, length] = bounds.range(size());
+			Typed_List result(this->get_allocator());
+			result.reserve(length);
+			for (std::size_t i = 0; i < length; ++i) {
+				std::size_t const index = start + std::ptrdiff_t(i) * step;
+				if constexpr (integers) result.append(item(index));
+				else                    result.push_back(Vector::operator[](index));
+			}
+			return result;
+		}
+	};
+}
+
+
+using list = python::List;
+using any = python::Value;
+
+list operator*(list const& l, python::Int n);
+list operator+(list lhs, list rhs);
+
+template<typename T>
+python::Typed_List<T> operator*(python::Typed_List<T> const& l, python::Int n)
+{
+	python::Typed_List<T> result(l.get_allocator());
+	auto const count = python::repeat_count(l.size(), n, result.max_size());
+
+	if constexpr (std::is_trivially_copyable_v<typename python::Typed_List<T>::Element>) {
+		if (!l.is_promoted()) [[likely]] {
+			result.resize(l.size() * count);
+			python::simd::repeat(l.data(), l.size(), result.data(), count);
+			return result;
+		}
+	}
+
+	result.reserve(l.size() * count);
+	for (std::size_t i = 0; i < count; ++i) {
+		result += l;
+	}
+	return result;
+}
+
+template<typename T>
+python::Typed_List<T> operator+(python::Typed_List<T> lhs, python::Typed_List<T> const& rhs)
+{
+	return lhs += rhs;
+}
+
+template<typename T>
+bool operator==(python::Typed_List<T> const& lhs, python::Typed_List<T> const& rhs)
+{
+	if (lhs.is_promoted() || rhs.is_promoted()) [[unlikely]] {
+		return std::equal(lhs.begin(), lhs.end(), rhs.begin(), rhs.end());
+	}
+	return lhs.size() == rhs.size() && python::simd::equal(lhs.data(), rhs.data(), lhs.size());
+}
+
+bool operator==(any const& lhs, list const& rhs);
+
+namespace python
+{
+	// Formatting writes into any sink providing write() for strings, characters
+	// and integers: buffered stdout for print() and Stream_Sink for iostreams.
+	void format(auto& out, std::integral auto value);
+	void format(auto& out, Bool value);
+	void format(auto& out, Integer const& value);
+	void format(auto& out, BigInt const& value);
+	void format(auto& out, Boolean value);
+	void format(auto& out, struct None);
+	void format(auto& out, Str const& value);
+	void format(auto& out, std::string_view value);
+	void format(auto& out, char const* value);
+	void format(auto& out, List const& value);
+	void format(auto& out, Dict const& value);
+	void format(auto& out, Set const& value);
+	template<typename T>
+	void format(auto& out, Typed_List<T> const& value);
+	void format(auto& out, Value const& value);
+
+	/// Writes value as it would be printed by Python's repr()
+	void repr(auto& out, auto const& value);
+	void repr(auto& out, Str const& value);
+	void repr(auto& out, Value const& value);
+
+	struct Stream_Sink
+	{
+		std::ostream& os;
+
+		void write(std::string_view s) { os << s; }
+		void write(char c) { os << c; }
+		void write(std::integral auto value) { os << value; }
+	};
+
+	/// Appends to string, which isn't shared, so it grows in place
+	struct Str_Sink
+	{
+		Str s;
+
+		void write(std::string_view part) { s += part; }
+		void write(char c) { s += std::string_view(&c, 1); }
+
+		void write(std::integral auto value)
+		{
+			char digits[24];
+			s += std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), value).ptr - digits);
+		}
+	};
+
+	void format(auto& out, std::integral auto value)
+	{
+		out.write(value);
+	}
+
+	void format(auto& out, Bool value)
+	{
+		out.write(value ? std::string_view("True") : std::string_view("False"));
+	}
+
+	void format(auto& out, Integer const& value)
+	{
+		if (value.is_small()) [[likely]] {
+			out.write(value.small);
+		} else {
+			format(out, *value.big);
+		}
+	}
+
+	void format(auto& out, BigInt const& value)
+	{
+		out.write(std::string_view(value.to_string()));
+	}
+
+	void format(auto& out, Boolean value)
+	{
+		format(out, value.value);
+	}
+
+	void format(auto& out, struct None)
+	{
+		out.write(std::string_view("None"));
+	}
+
+	void format(auto& out, Str const& value)
+	{
+		out.write(std::string_view(value));
+	}
+
+	void format(auto& out, std::string_view value)
+	{
+		out.write(value);
+	}
+
+	void format(auto& out, char const* value)
+	{
+		out.write(std::string_view(value));
+	}
+
+	void format_list(auto& out, auto const& list)
+	{
+		out.write('[');
+		for (auto it = list.begin(); it != list.end(); ++it) {
+			if (it != list.begin()) out.write(std::string_view(", "));
+			repr(out, *it);
+		}
+		out.write(']');
+	}
+
+	void format(auto& out, List const& value)
+	{
+		format_list(out, value);
+	}
+
+	void format(auto& out, Dict const& value)
+	{
+		out.write('{');
+		bool first = true;
+		for (auto const& entry : value.items()) {
+			if (!first) out.write(std::string_view(", "));
+			first = false;
+			repr(out, entry.key);
+			out.write(std::string_view(": "));
+			repr(out, entry.value);
+		}
+		out.write('}');
+	}
+
+	void format(auto& out, Set const& value)
+	{
+		if (value.size() == 0) {
+			out.write(std::string_view("set()"));
+			return;
+		}
+		out.write('{');
+		bool first = true;
+		for (auto const& element : value) {
+			if (!first) out.write(std::string_view(", "));
+			first = false;
+			repr(out, element);
+		}
+		out.write('}');
+	}
+
+	template<typename T>
+	void format(auto& out, Typed_List<T> const& value)
+	{
+		format_list(out, value);
+	}
+
+	void format(auto& out, Value const& value)
+	{
+		python::visit([&out](auto const& v) { format(out, v); }, static_cast<Value_Variant const&>(value));
+	}
+
+	void repr(auto& out, auto const& value)
+	{
+		format(out, value);
+	}
+
+	void repr(auto& out, Str const& value)
+	{
+		std::string_view const s = value;
+		char const quote = s.find('\'') != s.npos && s.find('"') == s.npos ? '"' : '\'';
+		out.write(quote);
+		for (char c : s) {
+			if (c == quote || c == '\\') out.write('\\');
+			if (c == '\n') { out.write(std::string_view("\\n")); continue; }
+			out.write(c);
+		}
+		out.write(quote);
+	}
+
+	void repr(auto& out, Value const& value)
+	{
+		if (auto p = get_if<Str>(&value); p) {
+			repr(out, *p);
+		} else {
+			format(out, value);
+		}
+	}
+}
+
+std::ostream& operator<<(std::ostream& os, list const& p);
+
+template<typename T>
+std::ostream& operator<<(std::ostream& os, python::Typed_List<T> const& p)
+{
+	python::Stream_Sink sink{os};
+	python::format(sink, p);
+	return os;
+}
+
+std::ostream& operator<<(std::ostream& os, any const& val);
+
+python::Str operator"" _str(char const* str, unsigned long length);
+
+inline python::Str str(std::integral auto v)
+{
+	char digits[24];
+	return python::Str(std::string_view(digits, std::to_chars(digits, digits + sizeof(digits), v).ptr - digits));
+}
+
+inline python::Str str(python::Bool v)
+{
+	return v ? "True" : "False";
+}
+
+inline python::Str str(python::Integer const& v)
+{
+	return v.is_small() ? str(v.small) : python::Str(v.big->to_string());
+}
+
+inline python::Str str(python::Str const& v)
+{
+	return v;
+}
+
+/// Formatted like by print()
+python::Str str(auto const& v) requires (!std::integral<std::decay_t<decltype(v)>>)
+{
+	python::Str_Sink sink;
+	python::format(sink, v);
+	return std::move(sink.s);
+}
+
+namespace python
+{
+	/// Printer with options of print() builtin, in order of Python's signature.
+	/// Transpiler initializes them directly from keyword arguments.
+	struct Printer
+	{
+		std::string_view sep = " ";
+		std::string_view end = "\n";
+		bool flush = false;
+
+		void print(auto const& ...args)
+		{
+			auto& out = stdout_buffer();
+			bool first = true;
+			((first ? void(first = false) : out.write(sep), format(out, args)), ...);
+			out.write(end);
+
+			if (flush || (out.line_buffered && std::memchr(out.buffer, '\n', out.size))) {
+				out.flush();
+			}
+		}
+	};
+}
+
+void print(python::Printer printer, auto const& ...args)
+{
+	printer.print(args...);
+}
+
+void print(auto const& ...args)
+{
+	python::Printer{}.print(args...);
+}
+
+inline python::File open(python::Str const& path, std::string_view mode = "r")
+{
+	return python::File::open(path, mode);
+}
+
+/// Line of standard input without newline, raises EOFError at the end of input
+python::Str input();
+python::Str input(python::Str const& prompt);
+
+// Entry point of generated program, called by main() from runtime.cc
+void compy_main();
 
 struct Range
 {
-	int from, to;
+	python::Int from, to, step = 1;
+
+	struct Sentinel {};
 
 	struct Iterator
 	{
-		int i;
+		python::Int i, to, step;
 
-		int operator*() const { return i; }
-		Iterator& operator++() { ++i; return *this; }
-		auto operator<=>(Iterator const& other) const = default;
+		python::Int operator*() const { return i; }
+		Iterator& operator++() { i += step; return *this; }
+		bool operator==(Sentinel) const { return step > 0 ? i >= to : i <= to; }
 	};
 
-	auto begin() const { return Iterator{from}; }
-	auto end() const { return Iterator{to}; }
+	auto begin() const { return Iterator{from, to, step}; }
+	auto end() const { return Sentinel{}; }
+
+	std::size_t size() const
+	{
+		if (step > 0 && from < to) return (to - from - 1) / step + 1;
+		if (step < 0 && from > to) return (from - to - 1) / -step + 1;
+		return 0;
+	}
 };
 
-Range range(int from, int to)
+namespace python
+{
+	/// Step of range(), raises ValueError when zero
+	inline Int range_step(Int step)
+	{
+		if (step == 0) [[unlikely]] throw value_error("range() arg 3 must not be zero");
+		return step;
+	}
+}
+
+inline Range range(python::Int from, python::Int to, python::Int step)
+{
+	return { from, to, python::range_step(step) };
+}
+
+inline Range range(python::Int from, python::Int to)
 {
 	return { from, to };
 }
 
-Range range(int to)
+inline Range range(python::Int to)
 {
 	return { 0, to };
 }
 
-int len(any const& val)
+namespace python
 {
-	return python::assert_type<python::List>(val, "len() expects iterable object").size();
+	/// Predicate of generator without condition
+	struct Always
+	{
+		bool operator()(auto const&) const { return true; }
+	};
+
+	/// Lazy iterable of function(x) for elements x of source, for which
+	/// predicate(x) holds, like generator expression. Each element of source
+	/// is computed once and function is applied to it when it's reached,
+	/// so chained generators run as single loop without temporary lists.
+	/// Temporary source is owned by generator, other ones are referenced.
+	template<typename Source, typename Predicate, typename Function>
+	struct Generator
+	{
+		Source source;
+		Predicate predicate;
+		Function function;
+
+		using Source_Iterator = decltype(std::declval<Source const&>().begin());
+		using Source_Sentinel = decltype(std::declval<Source const&>().end());
+		using Result = std::decay_t<std::invoke_result_t<Function const&, decltype(*std::declval<Source_Iterator&>())>>;
+
+		struct Sentinel {};
+
+		struct Iterator
+		{
+			Source_Iterator it;
+			Source_Sentinel last;
+			Generator const *generator;
+			std::optional<Result> current;
+
+			/// Result is computed once, so it's moved out
+			Result&& operator*() { return std::move(*current); }
+			Iterator& operator++() { ++it; next(); return *this; }
+			bool operator==(Sentinel) const { return !current; }
+
+			/// Computes result of the first element from it satisfying predicate
+			void next()
+			{
+				for (current.reset(); !(it == last); ++it) {
+					decltype(auto) element = *it;
+					if (generator->predicate(element)) {
+						current.emplace(generator->function(element));
+						return;
+					}
+				}
+			}
+		};
+
+		Iterator begin() const
+		{
+			Iterator result{ source.begin(), source.end(), this, std::nullopt };
+			result.next();
+			return result;
+		}
+
+		Sentinel end() const { return {}; }
+
+		/// Number of elements, known without condition
+		std::size_t size() const requires (std::is_same_v<Predicate, Always> && requires (Source const& s) { s.size(); })
+		{
+			return source.size();
+		}
+	};
+
+	template<typename Source, typename Predicate, typename Function>
+	Generator<Source, Predicate, Function> generator(Source &&source, Predicate predicate, Function function)
+	{
+		return { std::forward<Source>(source), std::move(predicate), std::move(function) };
+	}
+
+	/// List of elements of iterable, like `[x for x in iterable]`
+	template<typename List>
+	List collect(auto const& iterable)
+	{
+		List result;
+		if constexpr (requires { iterable.size(); }) result.reserve(iterable.size());
+		for (auto &&element : iterable) result.append(std::decay_t<decltype(element)>(std::forward<decltype(element)>(element)));
+		return result;
+	}
+
+	bool any_of(auto const& iterable)
+	{
+		for (auto const& element : iterable) if (bool(element)) return true;
+		return false;
+	}
+
+	bool all_of(auto const& iterable)
+	{
+		for (auto const& element : iterable) if (!bool(element)) return false;
+		return true;
+	}
+}
+
+python::Int len(any const& val);
+
+inline python::Int len(list const& val)
+{
+	return val.size();
+}
+
+inline python::Int len(python::Str const& val)
+{
+	return val.size();
+}
+
+/// Substring test of `needle in s`
+inline bool in(std::string_view needle, std::string_view s)
+{
+	return s.find(needle) != s.npos;
 }
 
-int len(list const& val)
+/// Lines read from files are views into buffer of reader
+inline python::Int len(std::string_view val)
 {
 	return val.size();
 }
 
+template<typename T>
+python::Int len(python::Typed_List<T> const& val)
+{
+	return val.size();
+}
+
+inline python::Int len(python::Dict const& val)
+{
+	return val.size();
+}
+
+inline python::Int len(python::Set const& val)
+{
+	return val.size();
+}
+
+bool in(auto const& key, python::Dict const& dict)
+{
+	return dict.find(key) != nullptr;
+}
+
+bool in(auto const& element, python::Set const& set)
+{
+	return set.contains(element);
+}
+
+inline python::Dict dict()
+{
+	return {};
+}
+
+inline python::Set set()
+{
+	return {};
+}
+
+python::Set set(auto const& iterable)
+{
+	python::Set result;
+	for (auto const& element : iterable) result.add(element);
+	return result;
+}
+
 bool in(auto const& value, list const& list)
 {
 	return std::find(list.begin(), list.end(), value) != list.end();
 }
+
+template<typename T>
+bool in(auto const& value, python::Typed_List<T> const& list)
+{
+	using Element = typename python::Typed_List<T>::Element;
+	if constexpr (python::Typed_List<T>::integers) {
+		if (list.is_promoted()) [[unlikely]] return std::find(list.begin(), list.end(), value) != list.end();
+		if (!python::integer::is_small(value)) return false;
+	}
+	return python::simd::find(list.data(), list.size(), Element(value)) != list.size();
+}
+
+template<typename T>
+auto sum(python::Typed_List<T> const& list)
+{
+	if constexpr (std::is_same_v<T, python::Bool>) {
+		return python::Int(std::count(list.begin(), list.end(), true));
+	} else {
+		T result;
+		if (!list.is_promoted() && python::simd::sum(list.data(), list.size(), result)) [[likely]] {
+			return python::Integer(result);
+		}
+		python::Integer total = 0;
+		for (auto const& element : list) total += element;
+		return total;
+	}
+}
+
+python::Integer sum(list const& list);
+
+/// Sum of elements of other iterables, like generators and ranges
+auto sum(auto const& iterable) requires requires { iterable.begin(); }
+{
+	using Element = std::decay_t<decltype(*iterable.begin())>;
+	if constexpr (std::is_same_v<Element, python::Value>) {
+		python::Value total = python::Integer(0);
+		for (auto const& element : iterable) total = total + element;
+		return total;
+	} else {
+		python::Integer total = 0;
+		for (auto const& element : iterable) total += element;
+		return total;
+	}
+}
+
+template<typename T>
+auto min(python::Typed_List<T> const& list)
+{
+	if (list.empty()) throw python::value_error("min() arg is an empty sequence");
+	if constexpr (python::Typed_List<T>::integers) {
+		if (list.is_promoted()) [[unlikely]] return *std::min_element(list.promoted.begin(), list.promoted.end());
+		return python::Integer(python::simd::min(list.data(), list.size()));
+	} else {
+		return T(python::simd::min(list.data(), list.size()));
+	}
+}
+
+template<typename T>
+auto max(python::Typed_List<T> const& list)
+{
+	if (list.empty()) throw python::value_error("max() arg is an empty sequence");
+	if constexpr (python::Typed_List<T>::integers) {
+		if (list.is_promoted()) [[unlikely]] return *std::max_element(list.promoted.begin(), list.promoted.end());
+		return python::Integer(python::simd::max(list.data(), list.size()));
+	} else {
+		return T(python::simd::max(list.data(), list.size()));
+	}
+}
+
+auto min(auto const& iterable) requires requires { iterable.begin(); }
+{
+	auto it = iterable.begin();
+	if (it == iterable.end()) throw python::value_error("min() arg is an empty sequence");
+	std::decay_t<decltype(*it)> result = *it;
+	for (++it; !(it == iterable.end()); ++it) if (*it < result) result = *it;
+	return result;
+}
+
+auto max(auto const& iterable) requires requires { iterable.begin(); }
+{
+	auto it = iterable.begin();
+	if (it == iterable.end()) throw python::value_error("max() arg is an empty sequence");
+	std::decay_t<decltype(*it)> result = *it;
+	for (++it; !(it == iterable.end()); ++it) if (result < *it) result = *it;
+	return result;
+}
+
+auto min(auto const& first, auto const& ...rest) requires (sizeof...(rest) > 0)
+{
+	std::common_type_t<std::decay_t<decltype(first)>, std::decay_t<decltype(rest)>...> result = first;
+	((rest < result ? void(result = rest) : void()), ...);
+	return result;
+}
+
+auto max(auto const& first, auto const& ...rest) requires (sizeof...(rest) > 0)
+{
+	std::common_type_t<std::decay_t<decltype(first)>, std::decay_t<decltype(rest)>...> result = first;
+	((result < rest ? void(result = rest) : void()), ...);
+	return result;
+}
+
+#endif // COMPY_STD_HH
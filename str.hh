@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <compare>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "allocation.hh"
+#include "integer.hh"
+
+// Python's str. Strings are immutable, so copies share their bytes: strings
+// up to 23 bytes are stored inline, longer ones in reference counted buffer,
+// which slices share too. Appending to string that is the only reference
+// to its buffer writes in place, like CPython does, so building string by
+// `s += x` stays linear. Slow paths live in runtime.cc.
+namespace python
+{
+	[[noreturn]] void throw_index_error(char const* message);
+
+	/// Bounds of slice, missing ones are None in Python
+	struct Slice
+	{
+		std::optional<Int> start = {}, stop = {}, step = {};
+
+		/// Selected indices of sequence, like slice.indices()
+		struct Range
+		{
+			std::ptrdiff_t start, step;
+			std::size_t length;
+		};
+
+		/// Raises ValueError when step is zero
+		Range range(std::size_t size) const;
+	};
+
+	struct Str
+	{
+		static constexpr std::size_t inline_capacity = 23;
+
+		Str() noexcept { set_inline_size(0); }
+		Str(char const* s) : Str(std::string_view(s)) {}
+		Str(char const* s, std::size_t n) : Str(std::string_view(s, n)) {}
+		Str(std::string const& s) : Str(std::string_view(s)) {}
+
+		explicit Str(std::string_view s)
+		{
+			if (s.size() <= inline_capacity) {
+				std::memcpy(chars, s.data(), s.size());
+				set_inline_size(s.size());
+			} else {
+				Buffer *buffer = allocate(s.size());
+				std::memcpy(buffer->bytes(), s.data(), s.size());
+				set_large(buffer->bytes(), buffer, s.size());
+			}
+		}
+
+		Str(Str const& other) noexcept
+		{
+			std::memcpy(static_cast<void*>(this), &other, sizeof(Str));
+			if (!is_inline()) large.buffer->references.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		Str(Str &&other) noexcept
+		{
+			std::memcpy(static_cast<void*>(this), &other, sizeof(Str));
+			other.set_inline_size(0);
+		}
+
+		Str& operator=(Str const& other) noexcept
+		{
+			if (this != &other) {
+				Str copy(other);
+				swap(copy);
+			}
+			return *this;
+		}
+
+		Str& operator=(Str &&other) noexcept
+		{
+			Str moved(std::move(other));
+			swap(moved);
+			return *this;
+		}
+
+		~Str()
+		{
+			if (!is_inline()) release(large.buffer);
+		}
+
+		/// String of given size, which bytes are written by fill(char*)
+		template<typename Fill>
+		static Str build(std::size_t size, Fill &&fill)
+		{
+			Str result;
+			if (size <= inline_capacity) {
+				fill(result.chars);
+				result.set_inline_size(size);
+			} else {
+				Buffer *buffer = allocate(size);
+				fill(buffer->bytes());
+				result.set_large(buffer->bytes(), buffer, size);
+			}
+			return result;
+		}
+
+		char const* data() const { return is_inline() ? chars : large.data; }
+
+		std::size_t size() const
+		{
+			if (is_inline()) return inline_capacity - std::uint8_t(chars[inline_capacity]);
+			return little_endian ? large.size & ~tag_mask : large.size >> 8;
+		}
+
+		bool empty() const { return size() == 0; }
+		explicit operator bool() const { return !empty(); }
+
+		operator std::string_view() const { return { data(), size() }; }
+		std::string_view view() const { return *this; }
+
+		/// Single character string, negative index counts from the end
+		Str operator[](Int index) const
+		{
+			auto const n = Int(size());
+			if (index < 0) index += n;
+			if (index < 0 || index >= n) [[unlikely]] throw_index_error("string index out of range");
+			return Str(std::string_view(data() + index, 1));
+		}
+
+		/// Substring sharing buffer of this one, copy when step isn't 1
+		Str slice(Slice const& bounds) const;
+
+		/// Appends in place when buffer isn't shared and has room
+		Str& operator+=(std::string_view s)
+		{
+			auto const n = size(), total = n + s.size();
+			if (is_inline() && total <= inline_capacity) {
+				std::memmove(chars + n, s.data(), s.size());
+				set_inline_size(total);
+			} else if (!is_inline() && unique() && large.data + total <= large.buffer->bytes() + large.buffer->capacity) {
+				std::memmove(const_cast<char*>(large.data) + n, s.data(), s.size());
+				set_large(large.data, large.buffer, total);
+			} else {
+				append_slow(s);
+			}
+			return *this;
+		}
+
+		/// Iteration yields single character strings, like in Python
+		struct Iterator
+		{
+			char const *p;
+
+			Str operator*() const { return Str(std::string_view(p, 1)); }
+			Iterator& operator++() { ++p; return *this; }
+			bool operator==(Iterator const&) const = default;
+		};
+
+		Iterator begin() const { return { data() }; }
+		Iterator end() const { return { data() + size() }; }
+
+		void swap(Str &other) noexcept
+		{
+			alignas(Str) std::byte tmp[sizeof(Str)];
+			std::memcpy(tmp, static_cast<void*>(this), sizeof(Str));
+			std::memcpy(static_cast<void*>(this), &other, sizeof(Str));
+			std::memcpy(static_cast<void*>(&other), tmp, sizeof(Str));
+		}
+
+	private:
+		/// Header of characters allocated right after it
+		struct Buffer
+		{
+			std::atomic<std::size_t> references;
+			std::size_t capacity;
+
+			char* bytes() { return reinterpret_cast<char*>(this + 1); }
+		};
+
+		struct Large
+		{
+			char const *data;
+			Buffer *buffer;
+
+			/// Size with tag in the byte shared with inline_capacity - size of inline strings
+			std::size_t size;
+		};
+
+		// Tag byte is the last one: inline_capacity - size for inline strings, so
+		// full string is still followed by zero, with the highest bit set otherwise
+		static constexpr bool little_endian = std::endian::native == std::endian::little;
+		static constexpr std::size_t tag_mask = little_endian ? std::size_t(0xff) << 56 : 0xff;
+
+		union
+		{
+			char chars[inline_capacity + 1];
+			Large large;
+		};
+
+		bool is_inline() const { return !(std::uint8_t(chars[inline_capacity]) & 0x80); }
+
+		void set_inline_size(std::size_t size)
+		{
+			if (size < inline_capacity) chars[size] = 0;
+			chars[inline_capacity] = char(inline_capacity - size);
+		}
+
+		void set_large(char const *data, Buffer *buffer, std::size_t size)
+		{
+			large = { data, buffer, little_endian ? size | std::size_t(0x80) << 56 : size << 8 | 0x80 };
+		}
+
+		bool unique() const { return large.buffer->references.load(std::memory_order_acquire) == 1; }
+
+		static Buffer* allocate(std::size_t capacity)
+		{
+			allocation::Scope scope(allocation::Category::Str);
+			auto *buffer = static_cast<Buffer*>(::operator new(sizeof(Buffer) + capacity));
+			buffer->references.store(1, std::memory_order_relaxed);
+			buffer->capacity = capacity;
+			return buffer;
+		}
+
+		static void release(Buffer *buffer)
+		{
+			// The only reference needs no atomic decrement
+			if (buffer->references.load(std::memory_order_acquire) == 1
+					|| buffer->references.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+				::operator delete(buffer);
+			}
+		}
+
+		/// Moves into new buffer with room for s, doubling capacity of strings owned by this one
+		void append_slow(std::string_view s);
+	};
+
+	static_assert(sizeof(Str) == 24);
+
+	inline bool operator==(Str const& lhs, Str const& rhs)
+	{
+		return lhs.view() == rhs.view();
+	}
+
+	inline std::strong_ordering operator<=>(Str const& lhs, Str const& rhs)
+	{
+		return lhs.view() <=> rhs.view();
+	}
+
+	inline Str operator+(Str const& lhs, Str const& rhs)
+	{
+		return Str::build(lhs.size() + rhs.size(), [&](char *p) {
+			std::memcpy(p, lhs.data(), lhs.size());
+			std::memcpy(p + lhs.size(), rhs.data(), rhs.size());
+		});
+	}
+
+	/// Temporary on the left, like in `s = s + x`, is appended to in place
+	inline Str operator+(Str &&lhs, Str const& rhs)
+	{
+		return std::move(lhs += rhs);
+	}
+
+	inline Str operator*(Str const& s, Int n)
+	{
+		auto const count = std::size_t(std::max<Int>(n, 0));
+		return Str::build(s.size() * count, [&](char *p) {
+			for (std::size_t i = 0; i < count; ++i) std::memcpy(p + i * s.size(), s.data(), s.size());
+		});
+	}
+
+	inline Str operator*(Int n, Str const& s)
+	{
+		return s * n;
+	}
+}